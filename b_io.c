@@ -22,26 +22,38 @@
 #include <math.h>
 
 #include "mfs.h"
+#include "blockCache.h"
 #include "fsLow.h"
 #include "pathparse.h"
+#include "dentryCache.h"
+#include "dirIndex.h"
+#include "extentTree.h"
 
 #include <stdbool.h>
 
 #define MAXFCBS 20
-#define B_CHUNK_SIZE 512
+#define B_CHUNK_SIZE (vcbPointer->blockSize)   // one file system block
+#define MAX_PENDING_BYTES (4 * 1024 * 1024)   // delayed allocation flushes once this much is buffered
+#define MAX_SPECULATIVE_BLOCKS 256              // cap on blocks reserved past EOF when a file grows
 
 typedef struct b_fcb {
     char* buff;     // holds the open file buffer
     int index;      // holds the current position in the buffer
     int dataInBuffer;     // holds how many valid bytes are in the buffer
 
-    short lbaPos;                 // current block position. allows working with main + extents
+    int64_t lbaPos;             // LBA of the block held in buff
     int flagRDWR;               // flag showing
-    short filePos;                // total number of bytes read
-    short blocksAtMainLoc;        // number of blocks at main location
+    off_t filePos;              // total number of bytes read
+    int64_t blocksAtMainLoc;    // number of blocks at main location
                                 //   (because this is virtually unknown if bytes exist in extents)
     struct fs_stat* fileInfo;   // access to extents and file size
     directoryEntry* parent;      // DE to edit (if write, creat, or trunc a file)
+
+    int64_t blocksAllocated;    // blocks owned by the file (main location + extents)
+    char* pending;              // delayed allocation: bytes written past the allocated blocks
+    int pendingLen;             //   that have no blocks yet, and how many of them there are
+    int pendingCap;             // size of the pending buffer
+    int blocksReserved;         // speculative blocks at the end of the last run, given back at close
 } b_fcb;
 
 b_fcb fcbArray[MAXFCBS];
@@ -53,6 +65,7 @@ void b_init() {
     // init fcbArray to all free
     for (int i = 0; i < MAXFCBS; i++) {
         fcbArray[i].buff = NULL;  // indicates a free fcbArray
+        fcbArray[i].pending = NULL;
     }
 
     startup = 1;
@@ -68,12 +81,63 @@ b_io_fd b_getFCB() {
     return (-1);  // all in use
 }
 
+/* FORWARD DECLARATION BLOCK */
+
+// Finds the file's DE in its parent and writes its size, location and extents back
+static int writeFileEntry(b_fcb * fcb);
+
+/**
+ * Maps a block index within the file to its LBA, following the main location
+ * and inline extents, or the extent tree for files that outgrew them.
+ * If runLeft is not NULL it receives the number of blocks from there to the end of that run.
+ * Returns -1 if the file has no such block.
+ */
+static int64_t fileBlockToLBA(b_fcb * fcb, int64_t fileBlock, int64_t * runLeft);
+
+// 1 if the file's runs live in an extent tree rather than the inline slots
+static int usesExtentTree(b_fcb * fcb);
+
+// Moves the main location and every inline extent into a new extent tree
+static int convertToExtentTree(b_fcb * fcb);
+
+// Writes count bytes at filePos into blocks the file already owns
+static int writeAllocated(b_fcb * fcb, char * buffer, int count);
+
+// Appends bytes past the allocated blocks to the pending buffer
+static int appendPending(b_fcb * fcb, char * buffer, int count);
+
+/**
+ * Delayed allocation: allocates one contiguous run for every pending byte,
+ * writes them out and updates the DE. Called by b_flush(), b_close() and
+ * before anything (seek, read) that needs the data to be on disk.
+ * With speculate set the run also reserves room past EOF (see growFile).
+ */
+static int flushPending(b_fcb * fcb, int speculate);
+
+// Adds blocks to the end of the file: a first run at the main location, the last run grown in place, or a new extent
+static int growFile(b_fcb * fcb, int64_t blocks);
+
+// Gives the unused speculative blocks at the end of the file back to the bitmap
+static int trimReserved(b_fcb * fcb);
+
+/* FORWARD DECLARATION BLOCK END*/
+
 // Interface to open a buffered file
 // Modification of interface for this assignment, flags match the Linux flags for open
 // O_RDONLY, O_WRONLY, or O_RDWR
 b_io_fd b_open(char* filename, int flags) {
+    return fs_openat(&curWorkingDir, filename, flags);
+}
+
+// Opens a file from a directory handle (see mfs.h); it lives here with the FCBs it hands out
+b_io_fd fs_openat(fdDir* dirp, const char* pathname, int flags) {
     b_io_fd returnFd;
 
+    // the parent is split off in place below
+    char filename[PATH_MAX];
+    strncpy(filename, pathname, PATH_MAX - 1);
+    filename[PATH_MAX - 1] = '\0';
+
     if (startup == 0) b_init();  // Initialize our system
 
     returnFd = b_getFCB();  // get our own file descriptor
@@ -88,14 +152,17 @@ b_io_fd b_open(char* filename, int flags) {
     b_fcb * fcb = &(fcbArray[returnFd]);
 
     // if passed a directory but not creating a file, exit because we dont open directories
-    if (fs_isDir(filename) == 1) {
+    directoryEntry * existing = parsePathAt(&dirp->entry, filename);
+    if (existing != NULL && existing->isDirectory) {
+        free(existing);
         fprintf(stderr, "ERROR: Directories can't be open as files\n");
         return -2;
     }
+    free(existing);
 
     // If fail to get fs_stat information AND not creating a file, return error -2
     fcb->fileInfo = malloc(sizeof(struct fs_stat));
-    int fsstatReturnVal = fs_stat(filename, fcb->fileInfo);
+    int fsstatReturnVal = fs_statat(dirp, filename, fcb->fileInfo);
     // file does not exists. creating       = false
     // file does not exists. not creating   = true
     // file exists. creating                = false
@@ -107,35 +174,25 @@ b_io_fd b_open(char* filename, int flags) {
     
     char * lastSlash = strrchr(filename, '/');
     char * filenameSeparated = NULL;
-    if (lastSlash == NULL && fs_isDir(filename) < 1) {
-        // get CWD
-        int dir_buf_length = 4096;
-        char * dir_buf = malloc(dir_buf_length + 1);
-        char * ptr = fs_getcwd(dir_buf, dir_buf_length);
-        if (ptr == NULL) {
-            fprintf(stderr, "ERROR: Failed to grab Current Working Directory.\n");
-            free(dir_buf);
-            return -4;  // error -4 if it failed to grab the CWD
-        }
-
-        // get DE of CWD
-        fcb->parent = parsePath(ptr);
-
+    if (lastSlash == NULL) {
+        // the handle keeps its directory's entry (fs_setcwd the cwd's), so a name in it
+        // needs no walk from the root
+        fcb->parent = malloc(sizeof(directoryEntry));
         if (fcb->parent == NULL) {
-            free(dir_buf);
-            fprintf(stderr, "ERROR: Failed to parse Current Working Directory as a path.\n");
-            return -5;  // error -5 if it failed to parse
+            fprintf(stderr, "Memory Allocation Error");
+            return -5;
         }
-
-        free(dir_buf);  // free the buffer for cwd path because useless now
+        memcpy(fcb->parent, &dirp->entry, sizeof(directoryEntry));
     }
     else {
-        char * parentPath = malloc(strlen(filename));
+        char * parentPath = malloc(strlen(filename) + 1);
         *lastSlash = '\0';
         strcpy(parentPath, filename);
+        if (lastSlash == filename)
+            strcpy(parentPath, "/");    // a file at the root
         filenameSeparated = lastSlash + 1;
 
-        fcb->parent = parsePath(parentPath);
+        fcb->parent = parsePathAt(&dirp->entry, parentPath);
 
         if (fcb->parent == NULL) {
             fprintf(stderr, "ERROR: Parent of path does not exist.\n");
@@ -147,6 +204,9 @@ b_io_fd b_open(char* filename, int flags) {
         free(parentPath);
     }
     
+    // the parent's own "." entry knows every extent it has grown
+    refreshDirectory(fcb->parent);
+
     /// Check for WriteOnly / ReadWrite flags using bitwise operators
     /// Default to ReadOnly if neither found
     if (flags & O_RDWR)
@@ -164,73 +224,30 @@ b_io_fd b_open(char* filename, int flags) {
         fcb->fileInfo->st_size      = 0;
         fcb->fileInfo->st_blocks    = 0;
         fcb->fileInfo->st_location  = -1;
+        memset(fcb->fileInfo->st_extents, 0, sizeof(extent) * MAX_EXTENTS);
 
         // temporary block of DE buffer
         directoryEntry * tempBlockBuf = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
 
-        int blockToEditDE = -1;
+        int64_t blockToEditDE = -1;
         int indexInBlock = -1;
-        // for main loc + each extent, look for blank DE or empty extent, whichever comes first
-        for (int i = -1; i < MAX_EXTENTS && indexInBlock < 0; i++) {
-            int loc = 0;
-
-            // if main loc
-            if (i == -1)
-                loc = fcb->parent->location;
-            // else extent
-            else
-                loc = fcb->parent->extentLocations[i].blockNumber;
-            
-            if (loc <= 0)
-                continue;
-
-            // read the DEs
-            for (int j = 0; j < INIT_NUM_OF_DIRECT; j++) {
-                // read a block every 8 entries
-                if (j % ENTRIES_PER_BLOCK == 0)
-				    LBAread(tempBlockBuf, 1, loc + (j / ENTRIES_PER_BLOCK));
-                
-                // current DE of block
-                directoryEntry * currEntry = &(tempBlockBuf[j % ENTRIES_PER_BLOCK]);
-
-                // If duplicate DE name found, exit with -1
-                if (strcmp(currEntry->name, filename) == 0) {
-                    blockToEditDE = loc + (j / ENTRIES_PER_BLOCK);
-                    indexInBlock = j % ENTRIES_PER_BLOCK;
-                    break;
-                }
-            }
+        if (findDirEntry(fcb->parent->location, (filenameSeparated != NULL) ? filenameSeparated : filename,
+                         NULL, &blockToEditDE, &indexInBlock) < 0) {
+            fprintf(stderr, "ERROR: Could not find the file's directory entry.\n");
+            free(tempBlockBuf);
+            return -3;
         }
 
         // Update the entry info to 0
-        LBAread(tempBlockBuf, 1, blockToEditDE);
+        readDirBlocks(tempBlockBuf, 1, blockToEditDE);
 
-        int blocksAtMainLocation = tempBlockBuf[indexInBlock].fileSize / B_CHUNK_SIZE + (tempBlockBuf[indexInBlock].fileSize % B_CHUNK_SIZE);
-        // reset all extent values to base
-        for (int i = 0; i < MAX_EXTENTS; i++) {
-            if (tempBlockBuf[indexInBlock].extentLocations[i].count > 0) {
-                blocksAtMainLocation -= tempBlockBuf[indexInBlock].extentLocations[i].count;
-
-                clearBlocks(
-                    tempBlockBuf[indexInBlock].extentLocations[i].blockNumber,
-                    tempBlockBuf[indexInBlock].extentLocations[i].count
-                );
-
-                tempBlockBuf[indexInBlock].extentLocations[i].blockNumber = 0;
-                tempBlockBuf[indexInBlock].extentLocations[i].count = 0;
-            }
-        }
-
-        if (tempBlockBuf[indexInBlock].location > 0 &&
-            tempBlockBuf[indexInBlock].fileSize > 0)
-        {
-            clearBlocks(tempBlockBuf[indexInBlock].location, blocksAtMainLocation);
-            tempBlockBuf[indexInBlock].location = -1;
-            tempBlockBuf[indexInBlock].fileSize = 0;
-        }
+        // give back the main location, every extent and any preallocated blocks
+        releaseEntryBlocks(&tempBlockBuf[indexInBlock]);
+        tempBlockBuf[indexInBlock].fileSize = 0;
 
         // write updated entry back
-        LBAwrite(tempBlockBuf, 1, blockToEditDE);
+        writeDirBlocks(tempBlockBuf, 1, blockToEditDE);
+        dentryCacheInvalidate(fcb->parent->location, tempBlockBuf[indexInBlock].name);
 
         free(tempBlockBuf);
     }
@@ -239,114 +256,33 @@ b_io_fd b_open(char* filename, int flags) {
     //      if file doesn't exist, create it
     //      whether file can be read from or written to is determined above
     if (fsstatReturnVal < 0 && (flags & O_CREAT)) {
-        // find a blank DE in curr working direc (at main loc OR in extents)
-        int blankDE_blockPos        = -1;
+        // find a blank DE in the parent, which grows when every DE is in use
+        int64_t blankDE_blockPos    = -1;
         int blankDE_indexInBlock    = -1;
-        int emptyExtentIndex        = -1;
-        
-        // temporary block of DE buffer
-        directoryEntry * tempBlockBuf = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
-
-        // for main loc + each extent, look for blank DE or empty extent, whichever comes first
-        for (int i = -1; i < MAX_EXTENTS && blankDE_indexInBlock < 0; i++) {
-            int loc = 0;
-
-            // if main loc
-            if (i == -1) {
-                loc = fcb->parent->location;
-            }
-            // else extent
-            else {
-                // exit if empty extent found
-                if (fcb->parent->extentLocations[i].count <= 0) {
-                    emptyExtentIndex = i;
-                    break;
-                }
-                // otherwise we have to read the extent
-                loc = fcb->parent->extentLocations[i].blockNumber;
-            }
-
-            if (loc <= 0)
-                continue;
-
-            // read the DEs
-            for (int j = 0; j < INIT_NUM_OF_DIRECT; j++) {
-                // read a block every 8 entries
-                if (j % ENTRIES_PER_BLOCK == 0)
-				    LBAread(tempBlockBuf, 1, loc + (j / ENTRIES_PER_BLOCK));
-                
-                // current DE of block
-                directoryEntry * currEntry = &(tempBlockBuf[j % ENTRIES_PER_BLOCK]);
-
-                // exit if blank DE found
-                if (blankDE_indexInBlock < 0 && currEntry->date < 0) {
-                    blankDE_blockPos = loc + (j / ENTRIES_PER_BLOCK);
-                    blankDE_indexInBlock = j % ENTRIES_PER_BLOCK;
-                    break;
-                }
-            }
-        }
-
-        // if no empty DE or free extent found
-        if (blankDE_indexInBlock < 0 && emptyExtentIndex < 0) {
+        if (findFreeDirSlot(fcb->parent->location, &blankDE_blockPos, &blankDE_indexInBlock) < 0) {
             fprintf(stderr, "ERROR: No free Directory Entries.\n");
-            free(tempBlockBuf);
-
             return -6;
         }
 
-        // create a DE for the new file with filename and size 0 at current time at allocated loc
+        // create a DE for the new file with filename and size 0 at current time
         directoryEntry * entry = malloc(DE_SIZE);
         if (filenameSeparated == NULL)
             createEntry(entry, filename, false, 0, time(0), -1);
         else
             createEntry(entry, filenameSeparated, false, 0, time(0), -1);
 
-        // if empty extent found
-        if (emptyExtentIndex > -1) {
-            // allocate for empty extent to fill
-            int mapLoc_newExtent = allocateFirstBlocks(INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK);
-            // if failed to allocate to extent
-            if (mapLoc_newExtent < 0) {
-                fprintf(stderr, "ERROR: Could not allocate for new Extent.\n");
-                free(entry);
-                free(tempBlockBuf);
-
-                return -7;
-            }
-
-            // Fill every DE of the newly allocated extent with free DEs
-            for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-                // first entry is the DE of the new file
-                if (i == 0) {
-                    memcpy(&(tempBlockBuf[i % ENTRIES_PER_BLOCK]), entry, DE_SIZE);
-                }
-                // others are blank DE
-                else
-                    createEntry(&(tempBlockBuf[i % ENTRIES_PER_BLOCK]), "", false, 0, -1, -1);
-                
-                // Write to volume every 8 entries
-                if (i % ENTRIES_PER_BLOCK == ENTRIES_PER_BLOCK - 1)
-                    LBAwrite(tempBlockBuf, 1, mapLoc_newExtent + (i / ENTRIES_PER_BLOCK));
-            }
-
-            // update parent's DE size and extent info
-            LBAread(tempBlockBuf, 1, fcb->parent->location);
-
-            tempBlockBuf[0].fileSize += INIT_NUM_OF_DIRECT * DE_SIZE;
-            tempBlockBuf[0].extentLocations[emptyExtentIndex].blockNumber = mapLoc_newExtent;
-            tempBlockBuf[0].extentLocations[emptyExtentIndex].count = INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK;
+        // temporary block of DE buffer
+        directoryEntry * tempBlockBuf = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
 
-            LBAwrite(tempBlockBuf, 1, fcb->parent->location);
-        }
-        // otherwise empty DE found
-        else {
-            LBAread(tempBlockBuf, 1, blankDE_blockPos);
-            copyEntry(&tempBlockBuf[blankDE_indexInBlock], entry->name, false, 0, entry->date, -1, (entry->extentLocations));
-            LBAwrite(tempBlockBuf, 1, blankDE_blockPos);
-        }
+        readDirBlocks(tempBlockBuf, 1, blankDE_blockPos);
+        copyEntry(&tempBlockBuf[blankDE_indexInBlock], entry->name, false, 0, entry->date, -1, (entry->extentLocations));
+        writeDirBlocks(tempBlockBuf, 1, blankDE_blockPos);
         free(tempBlockBuf);
 
+        // the parent's index learns the new name once the entry is on disk
+        dirIndexAdd(fcb->parent->location, entry->name, blankDE_blockPos, blankDE_indexInBlock);
+        dentryCacheCreated(fcb->parent->location, entry->name);
+
         free(entry);
 
         // grab fs_stat info again because it should exist now
@@ -355,11 +291,11 @@ b_io_fd b_open(char* filename, int flags) {
             //*lastSlash = '/';
             //printf("[%s]\n", filename);
 
-            fs_stat(filename, fcb->fileInfo);
+            fs_statat(dirp, filename, fcb->fileInfo);
             //*lastSlash = '\0';
         }
         else
-            fs_stat(filename, fcb->fileInfo);
+            fs_statat(dirp, filename, fcb->fileInfo);
     }
 
     // Allocate buffer of CHUNK size, return -3 if error
@@ -378,12 +314,37 @@ b_io_fd b_open(char* filename, int flags) {
     
     fcb->blocksAtMainLoc = fcb->fileInfo->st_blocks;
     for (int i = 0; i < MAX_EXTENTS && fcb->fileInfo->st_size > 0; i++) {
-        int count = fcb->fileInfo->st_extents[i].count;
+        int64_t count = fcb->fileInfo->st_extents[i].count;
 
         if (count > 0)
             fcb->blocksAtMainLoc -= count;
     }
 
+    // preallocated files hold their first run in extent 0 too (see entryBlocksAtMainLoc)
+    if (fcb->fileInfo->st_extents[0].count > 0 &&
+        fcb->fileInfo->st_extents[0].blockNumber == fcb->fileInfo->st_location)
+        fcb->blocksAtMainLoc = 0;
+    if (fcb->blocksAtMainLoc < 0)
+        fcb->blocksAtMainLoc = 0;
+
+    // blocks the file owns right now; anything written past them is delayed
+    fcb->blocksAllocated = 0;
+    if (usesExtentTree(fcb)) {
+        fcb->blocksAtMainLoc = 0;
+        fcb->blocksAllocated = extentTreeBlocks(fcb->fileInfo->st_extents[0].blockNumber);
+    }
+    else if (fcb->fileInfo->st_location > 0) {
+        fcb->blocksAllocated = fcb->blocksAtMainLoc;
+        for (int i = 0; i < MAX_EXTENTS; i++) {
+            if (fcb->fileInfo->st_extents[i].count > 0)
+                fcb->blocksAllocated += fcb->fileInfo->st_extents[i].count;
+        }
+    }
+    fcb->pending    = NULL;
+    fcb->pendingLen = 0;
+    fcb->pendingCap = 0;
+    fcb->blocksReserved = 0;
+
     return (returnFd);  // all set
 }
 
@@ -402,13 +363,17 @@ int b_seek(b_io_fd fd, off_t offset, int whence) {
     if (fcb->buff == NULL || fcb->fileInfo == NULL)
         return -1;
 
-    if (fcb->lbaPos < 0)
+    // delayed bytes need their blocks before the position can move
+    if (flushPending(fcb, 1) < 0)
+        return -3;
+
+    if (fcb->blocksAllocated == 0)
         return 0;
     
     // Current index in the file
-    int fileIndex = fcb->filePos;
-    int fileSize = fcb->fileInfo->st_size;
-    int seekPos = 0;
+    off_t fileIndex = fcb->filePos;
+    off_t fileSize = fcb->fileInfo->st_size;
+    off_t seekPos = 0;
 
     // IF Seek from beginning of file
     // IF Seek from current index in file
@@ -430,43 +395,18 @@ int b_seek(b_io_fd fd, off_t offset, int whence) {
         fcb->filePos = seekPos;
 
         // Update lba position
-        int blkOffsetFromBeg = seekPos / B_CHUNK_SIZE;
-        for (int i = -1; i < MAX_EXTENTS; i++) {
-            // If mainLoc
-            if (i == -1)
-            {
-                // If the difference is >0, range is [mainLoc, mainLoc + blockAtMainLoc)
-                if (fcb->blocksAtMainLoc - blkOffsetFromBeg > 0) {
-                    fcb->lbaPos = fcb->fileInfo->st_location + blkOffsetFromBeg;
-                    break;
-                }
-
-                // Else subtract blocks at main because range is elsewhere
-                blkOffsetFromBeg -= fcb->blocksAtMainLoc;
-            }
-            // Otherwise in an extent
-            else {
-                extent * ext = &(fcb->fileInfo->st_extents[i]);
-
-                // If the difference is >0, range is [blockNumber, blockNumber + count)
-                if (ext->count - blkOffsetFromBeg > 0) {
-                    fcb->lbaPos = ext->blockNumber + blkOffsetFromBeg;
-                    break;
-                }
-
-                // Else subtract count because range is in other extent
-                blkOffsetFromBeg -= ext->count;
-            }
-        }
+        fcb->lbaPos = fileBlockToLBA(fcb, seekPos / B_CHUNK_SIZE, NULL);
 
         // Update buffer index
         fcb->index = seekPos % B_CHUNK_SIZE;
 
         // Update the buffer to the current, as long as not at EOF
         if (seekPos != fileSize) {
-            LBAread(fcb->buff, 1, fcb->lbaPos);
+            cachedLBAread(fcb->buff, 1, fcb->lbaPos);
             fcb->dataInBuffer = 1;
         }
+        else
+            fcb->dataInBuffer = 0;
     }
 
     return seekPos;
@@ -500,133 +440,74 @@ int b_write(b_io_fd fd, char* buffer, int count) {
     if (count == 0)
         return 0;
 
-    int fileLoc = fcb->fileInfo->st_location;
-    int fileSize = fcb->fileInfo->st_size;
     int bytesBuffered = 0;
 
-    // If file has no location allocated
-    if (fcb->lbaPos <= 0) {
-        // allocate some blocks
-        int blocksNeeded = (count + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE;
-        int afbReturn = allocateFirstBlocks(blocksNeeded);
-        // if couldn't allocate blocks
-        if (afbReturn < 0) {
-            fprintf(stderr, "ERROR: Could not allocate initial blocks for file.\n");
-            return -3;
+    // Delayed allocation: bytes landing in blocks the file already owns are
+    // written now, bytes past them wait in memory so that the whole tail of
+    // the file gets one contiguous run at b_flush() / b_close()
+    while (bytesBuffered < count) {
+        off_t capacity = fcb->blocksAllocated * B_CHUNK_SIZE;
+        int chunk = count - bytesBuffered;
+
+        if (fcb->pendingLen == 0 && fcb->filePos < capacity) {
+            if (chunk > capacity - fcb->filePos)
+                chunk = capacity - fcb->filePos;
+            writeAllocated(fcb, buffer + bytesBuffered, chunk);
+        }
+        else {
+            if (chunk > MAX_PENDING_BYTES - fcb->pendingLen)
+                chunk = MAX_PENDING_BYTES - fcb->pendingLen;
+            if (appendPending(fcb, buffer + bytesBuffered, chunk) < 0)
+                return -3;
         }
-        
-        fcb->lbaPos = afbReturn;
-        fileLoc = afbReturn;
-        fcb->blocksAtMainLoc = blocksNeeded;
-        fcb->fileInfo->st_location = afbReturn;
-        fcb->fileInfo->st_blocks = blocksNeeded;
 
-        // temporary block of DE buffer
-        directoryEntry * tempBlockBuf = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
+        bytesBuffered += chunk;
+        fcb->filePos += chunk;
 
-        int blockToEditDE = -1;
-        int indexInBlock = -1;
-        // for main loc + each extent, look for blank DE or empty extent, whichever comes first
-        for (int i = -1; i < MAX_EXTENTS && indexInBlock < 0; i++) {
-            int loc = 0;
-
-            // if main loc
-            if (i == -1)
-                loc = fcb->parent->location;
-            // else extent
-            else
-                loc = fcb->parent->extentLocations[i].blockNumber;
-            
-            if (loc <= 0)
-                continue;
-
-            // read the DEs
-            for (int j = 0; j < INIT_NUM_OF_DIRECT; j++) {
-                // read a block every 8 entries
-                if (j % ENTRIES_PER_BLOCK == 0)
-				    LBAread(tempBlockBuf, 1, loc + (j / ENTRIES_PER_BLOCK));
-                
-                // current DE of block
-                directoryEntry * currEntry = &(tempBlockBuf[j % ENTRIES_PER_BLOCK]);
+        // bound the memory held per file
+        if (fcb->pendingLen == MAX_PENDING_BYTES && flushPending(fcb, 1) < 0)
+            return -3;
+    }
 
-                // If DE found, break
-                if (strcmp(currEntry->name, fcb->fileInfo->st_name) == 0) {
-                    blockToEditDE = loc + (j / ENTRIES_PER_BLOCK);
-                    indexInBlock = j % ENTRIES_PER_BLOCK;
-                    break;
-                }
-            }
-        }
+    if (fcb->filePos > fcb->fileInfo->st_size) {
+        fcb->fileInfo->st_size = fcb->filePos;
 
-        // update entry in info volume
-        LBAread(tempBlockBuf, 1, blockToEditDE);
+        // with bytes still pending the DE is updated when they get their blocks
+        if (fcb->pendingLen == 0)
+            writeFileEntry(fcb);
+    }
 
-        tempBlockBuf[indexInBlock].location = afbReturn;
-        
-        LBAwrite(tempBlockBuf, 1, blockToEditDE);
+    return bytesBuffered;               // return number of bytes that were written
+}
 
-        free(tempBlockBuf);
-    }   
-    // If filePos + count > EOF pos, and we have to write more characters, so allocate more blocks
-    else if ((fileSize + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE < ((fcb->filePos + count) + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE) {
-        // Number of blocks to add based on how many characters are to written past the file size
-        int blocksNeeded = (((fcb->filePos + count) + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE) - ((fileSize + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE);
-
-        int aabReturn = allocateAdditionalBlocks(
-            fcb->fileInfo->st_location,
-            fcb->blocksAtMainLoc,
-            blocksNeeded,
-            fcb->fileInfo->st_extents
-        );
-
-        // If couldn't allocate more blocks, error -3
-        if (aabReturn < 0) {
-            fprintf(stderr, "ERROR: Could not allocate new blocks for file.\n");
-            return -3;
-        }
-        
-        if (aabReturn == 0)
-            fcb->blocksAtMainLoc += blocksNeeded;
-        
-        // Update fileInfo values
-        fcb->fileInfo->st_blocks += blocksNeeded;
-    }
+static int writeAllocated(b_fcb * fcb, char * buffer, int count) {
+    int bytesBuffered = 0;
 
     // While there are bytes to be written
     while (count != bytesBuffered) {
-        // If we can write entire contiguous LBAs, requires useable bytes in buffer to be 0
+        int64_t blockInFile = (fcb->filePos + bytesBuffered) / B_CHUNK_SIZE;
+
+        // If we can write entire contiguous LBAs, requires useable bytes in buffer to be 0 and a block aligned position
         int wholeLBAs = (count - bytesBuffered) / B_CHUNK_SIZE;
-        if (wholeLBAs > 0 && fcb->dataInBuffer == 0) {
-            // Check if lbaPos within range of mainLoc [main location, main location furthest block]
-            if (fcb->fileInfo->st_location <= fcb->lbaPos &&
-                fcb->lbaPos < fcb->fileInfo->st_location + fcb->blocksAtMainLoc)
-            {
-                wholeLBAs = (fcb->fileInfo->st_location + fcb->blocksAtMainLoc) - fcb->lbaPos;
-            }
-            // If lbaPos not in range of mainLoc, check each extent
-            else {
-                for (int i = 0; i < MAX_EXTENTS; i++) {
-                    extent * currExt = &(fcb->fileInfo->st_extents[i]);
-
-                    // Check if valid extent
-                    if (currExt->count > 0 &&
-                        // Check if lbaPos within range of extent [extent location, extent location furthest block]
-                        currExt->blockNumber <= fcb->lbaPos &&
-                        fcb->lbaPos < currExt->blockNumber + currExt->count)
-                    {
-                        wholeLBAs = (currExt->blockNumber + currExt->count) - fcb->lbaPos;
-                        break;
-                    }
-                }
-            }
+        if (wholeLBAs > 0 && fcb->dataInBuffer == 0 && fcb->index == 0) {
+            // never more than asked for, never past the end of the run
+            int64_t runLeft = 0;
+            int64_t lba = fileBlockToLBA(fcb, blockInFile, &runLeft);
+            if (lba < 0)
+                break;
+            if (runLeft < wholeLBAs)
+                wholeLBAs = runLeft;
 
-            fcb->lbaPos += LBAwrite(buffer + bytesBuffered, wholeLBAs, fcb->lbaPos);
+            cachedLBAwrite(buffer + bytesBuffered, wholeLBAs, lba);
             bytesBuffered += wholeLBAs * B_CHUNK_SIZE;
         }
         else {
             // Read a block if buffer has no bytes
             if (fcb->dataInBuffer == 0) {
-                LBAread(fcb->buff, 1, fcb->lbaPos);
+                fcb->lbaPos = fileBlockToLBA(fcb, blockInFile, NULL);
+                if (fcb->lbaPos < 0)
+                    break;
+                cachedLBAread(fcb->buff, 1, fcb->lbaPos);
                 
                 fcb->dataInBuffer = 1;
             }
@@ -642,92 +523,303 @@ int b_write(b_io_fd fd, char* buffer, int count) {
             memcpy(fcb->buff + fcb->index, buffer + bytesBuffered, bytesToCopy);
             bytesBuffered   += bytesToCopy;
             fcb->index      += bytesToCopy;
-            //fcb->buflen     -= bytesToCopy;
 
             // Write the block back
-            LBAwrite(fcb->buff, 1, fcb->lbaPos);
+            cachedLBAwrite(fcb->buff, 1, fcb->lbaPos);
 
             // if entire buffer writtern: data in buffer is useless
             if (fcb->index == B_CHUNK_SIZE) {
                 fcb->dataInBuffer = 0;    
                 fcb->index  = 0;    // reset buffer position to 0
-                fcb->lbaPos += 1;
             }
         }
+    }
 
-        // check if lbaPos is 1 above useable blocks
-        for (int i = -1; i < MAX_EXTENTS; i++) {
-            // if 1 above main location, set location to first extent
-            if (i == -1 &&
-                fcb->lbaPos == fcb->fileInfo->st_location + fcb->blocksAtMainLoc &&
-                fcb->fileInfo->st_extents[i + 1].count > 0)
-            {
-                fcb->lbaPos = fcb->fileInfo->st_extents[i + 1].blockNumber;
-                break;
-            }
-            // except for last extent, if 1 above extent, set location to next extent
-            else if (i < MAX_EXTENTS - 1 &&
-                fcb->lbaPos == fcb->fileInfo->st_extents[i].blockNumber + fcb->fileInfo->st_extents[i].count &&
-                fcb->fileInfo->st_extents[i + 1].count > 0)
-            {
-                fcb->lbaPos = fcb->fileInfo->st_extents[i + 1].blockNumber;
-                break;
-            }
+    return bytesBuffered;
+}
+
+static int appendPending(b_fcb * fcb, char * buffer, int count) {
+    if (fcb->pendingLen + count > fcb->pendingCap) {
+        // grow geometrically, always by whole blocks so the flush can pad in place
+        int newCap = (fcb->pendingCap > 0) ? fcb->pendingCap * 2 : B_CHUNK_SIZE * 8;
+        while (newCap < fcb->pendingLen + count)
+            newCap *= 2;
+        if (newCap > MAX_PENDING_BYTES)
+            newCap = MAX_PENDING_BYTES;
+
+        char * grown = realloc(fcb->pending, newCap);
+        if (grown == NULL) {
+            fprintf(stderr, "ERROR: Could not malloc for the pending write buffer\n");
+            return -1;
         }
+        fcb->pending = grown;
+        fcb->pendingCap = newCap;
     }
 
-    fcb->filePos += bytesBuffered;      // update total number of bytes written
-    if (fcb->filePos > fcb->fileInfo->st_size) {
-        fcb->fileInfo->st_size = fcb->filePos;
+    memcpy(fcb->pending + fcb->pendingLen, buffer, count);
+    fcb->pendingLen += count;
+    return count;
+}
 
-        // temporary block of DE buffer
-        directoryEntry * tempBlockBuf = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
+static int flushPending(b_fcb * fcb, int speculate) {
+    if (fcb->pendingLen == 0)
+        return 0;
 
-        int blockToEditDE = -1;
-        int indexInBlock = -1;
-        // for main loc + each extent, look for matching entry
-        for (int i = -1; i < MAX_EXTENTS && indexInBlock < 0; i++) {
-            int loc = 0;
-
-            // if main loc
-            if (i == -1)
-                loc = fcb->parent->location;
-            // else extent
-            else
-                loc = fcb->parent->extentLocations[i].blockNumber;
-            
-            if (loc <= 0)
-                continue;
-
-            // read the DEs
-            for (int j = 0; j < INIT_NUM_OF_DIRECT; j++) {
-                // read a block every 8 entries
-                if (j % ENTRIES_PER_BLOCK == 0)
-				    LBAread(tempBlockBuf, 1, loc + (j / ENTRIES_PER_BLOCK));
-                
-                // current DE of block
-                directoryEntry * currEntry = &(tempBlockBuf[j % ENTRIES_PER_BLOCK]);
+    int blocksNeeded = (fcb->pendingLen + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE;
+    int64_t oldBlocks = fcb->blocksAllocated;
+
+    // Speculative over-allocation: a growing file reserves as much again as it
+    // will hold (doubling, up to MAX_SPECULATIVE_BLOCKS) so the next appends
+    // land in the same run instead of using up the extents
+    int64_t extra = 0;
+    if (speculate) {
+        extra = oldBlocks + blocksNeeded;
+        if (extra > MAX_SPECULATIVE_BLOCKS)
+            extra = MAX_SPECULATIVE_BLOCKS;
+    }
 
-                // If DE found, break
-                if (strcmp(currEntry->name, fcb->fileInfo->st_name) == 0) {
-                    blockToEditDE = loc + (j / ENTRIES_PER_BLOCK);
-                    indexInBlock = j % ENTRIES_PER_BLOCK;
-                    break;
-                }
-            }
+    // fall back to the exact size when there is no run long enough for the reserve
+    if (!(extra > 0 && growFile(fcb, blocksNeeded + extra) == 0)) {
+        extra = 0;
+        if (growFile(fcb, blocksNeeded) < 0) {
+            fprintf(stderr, "ERROR: Could not allocate new blocks for file.\n");
+            return -3;
+        }
+    }
+
+    fcb->blocksAllocated += blocksNeeded + extra;
+    fcb->blocksReserved = extra;
+    fcb->fileInfo->st_blocks = fcb->blocksAllocated;
+
+    // the new blocks are contiguous, so one write covers them
+    int64_t runStart = fileBlockToLBA(fcb, oldBlocks, NULL);
+
+    // zero the slack of the last block so no stale data becomes part of the file
+    memset(fcb->pending + fcb->pendingLen, 0, blocksNeeded * B_CHUNK_SIZE - fcb->pendingLen);
+    cachedLBAwrite(fcb->pending, blocksNeeded, runStart);
+
+    // keep a partly filled last block in the file buffer so the next write continues in it
+    int tail = fcb->pendingLen % B_CHUNK_SIZE;
+    if (tail > 0) {
+        memcpy(fcb->buff, fcb->pending + (blocksNeeded - 1) * B_CHUNK_SIZE, B_CHUNK_SIZE);
+        fcb->lbaPos = runStart + blocksNeeded - 1;
+        fcb->index = tail;
+        fcb->dataInBuffer = 1;
+    }
+    else {
+        fcb->lbaPos = runStart + blocksNeeded;
+        fcb->index = 0;
+        fcb->dataInBuffer = 0;
+    }
+    fcb->pendingLen = 0;
+
+    return writeFileEntry(fcb);
+}
+
+static int growFile(b_fcb * fcb, int64_t blocks) {
+    // If file has no location allocated, the run becomes its main location
+    if (fcb->blocksAllocated == 0) {
+        int64_t afbReturn = allocateBlocksNear(blocks, fcb->parent->location);
+        if (afbReturn < 0)
+            return -1;
+
+        fcb->fileInfo->st_location = afbReturn;
+        fcb->blocksAtMainLoc = blocks;
+        return 0;
+    }
+
+    // every inline slot is taken: from here on the runs live in an extent tree
+    if (!usesExtentTree(fcb) && fcb->fileInfo->st_extents[MAX_EXTENTS - 1].count > 0) {
+        if (convertToExtentTree(fcb) < 0)
+            return -1;
+    }
+
+    if (usesExtentTree(fcb)) {
+        int64_t root = fcb->fileInfo->st_extents[0].blockNumber;
+        extentRecord last;
+        if (extentTreeLast(root, &last) < 0)
+            return -1;
+
+        // grow the last run in place if the blocks after it are free, otherwise the new run lands in scratch[0]
+        extent scratch[MAX_EXTENTS] = {{0, 0}};
+        int aabReturn = allocateAdditionalBlocks(last.blockNumber, last.count, blocks, scratch);
+        if (aabReturn < 0)
+            return -1;
+
+        if (aabReturn == 0)
+            return extentTreeSetLastCount(root, last.count + blocks);
+
+        extentRecord run = { last.fileBlock + last.count, scratch[0].blockNumber, blocks };
+        int64_t newRoot = extentTreeAppend(root, &run);
+        if (newRoot < 0) {
+            clearBlocks(run.blockNumber, run.count);
+            return -1;
         }
+        fcb->fileInfo->st_extents[0].blockNumber = newRoot;
+        return 0;
+    }
+
+    int usedExtents = 0;
+    for (int i = 0; i < MAX_EXTENTS; i++) {
+        if (fcb->fileInfo->st_extents[i].count > 0)
+            usedExtents = 1;
+    }
+
+    int aabReturn = allocateAdditionalBlocks(
+        fcb->fileInfo->st_location,
+        fcb->blocksAtMainLoc,
+        blocks,
+        fcb->fileInfo->st_extents
+    );
+    if (aabReturn < 0)
+        return -1;
+
+    // grown in place with no extents yet: the main location got longer
+    if (aabReturn == 0 && !usedExtents)
+        fcb->blocksAtMainLoc += blocks;
+    return 0;
+}
+
+static int usesExtentTree(b_fcb * fcb) {
+    return fcb->fileInfo->st_extents[0].count == EXTENT_TREE_MARKER;
+}
+
+static int convertToExtentTree(b_fcb * fcb) {
+    extentRecord records[MAX_EXTENTS + 1];
+    int numRecords = 0;
+    int64_t fileBlock = 0;
+
+    if (fcb->blocksAtMainLoc > 0) {
+        records[numRecords++] = (extentRecord){ 0, fcb->fileInfo->st_location, fcb->blocksAtMainLoc };
+        fileBlock = fcb->blocksAtMainLoc;
+    }
+    for (int i = 0; i < MAX_EXTENTS; i++) {
+        extent * ext = &(fcb->fileInfo->st_extents[i]);
+        if (ext->count <= 0)
+            continue;
+        records[numRecords++] = (extentRecord){ fileBlock, ext->blockNumber, ext->count };
+        fileBlock += ext->count;
+    }
 
-        // update entry in info volume
-        LBAread(tempBlockBuf, 1, blockToEditDE);
+    int64_t root = extentTreeBuild(records, numRecords, fcb->fileInfo->st_location);
+    if (root < 0) {
+        fprintf(stderr, "ERROR: Could not allocate an extent tree for file.\n");
+        return -1;
+    }
 
-        tempBlockBuf[indexInBlock].fileSize = fcb->fileInfo->st_size;
-        
-        LBAwrite(tempBlockBuf, 1, blockToEditDE);
+    memset(fcb->fileInfo->st_extents, 0, sizeof(extent) * MAX_EXTENTS);
+    fcb->fileInfo->st_extents[0].blockNumber = root;
+    fcb->fileInfo->st_extents[0].count = EXTENT_TREE_MARKER;
+    fcb->blocksAtMainLoc = 0;
+    return 0;
+}
 
+static int trimReserved(b_fcb * fcb) {
+    // only what is still past the end of the data goes back
+    int64_t dataBlocks = (fcb->fileInfo->st_size + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE;
+    int64_t unused = fcb->blocksAllocated - dataBlocks;
+    if (unused > fcb->blocksReserved)
+        unused = fcb->blocksReserved;
+    fcb->blocksReserved = 0;
+
+    if (unused <= 0)
+        return 0;
+
+    // the reserve is always the tail of the last run
+    if (usesExtentTree(fcb)) {
+        int64_t root = fcb->fileInfo->st_extents[0].blockNumber;
+        extentRecord lastRun;
+        if (extentTreeLast(root, &lastRun) < 0 ||
+            extentTreeSetLastCount(root, lastRun.count - unused) < 0)
+            return -3;
+        clearBlocks(lastRun.blockNumber + lastRun.count - unused, unused);
+
+        fcb->blocksAllocated -= unused;
+        fcb->fileInfo->st_blocks = fcb->blocksAllocated;
+        return writeFileEntry(fcb);
+    }
+
+    int last = -1;
+    for (int i = 0; i < MAX_EXTENTS; i++) {
+        if (fcb->fileInfo->st_extents[i].count > 0)
+            last = i;
+    }
+
+    if (last >= 0) {
+        extent * ext = &(fcb->fileInfo->st_extents[last]);
+        clearBlocks(ext->blockNumber + ext->count - unused, unused);
+        ext->count -= unused;
+    }
+    else {
+        clearBlocks(fcb->fileInfo->st_location + fcb->blocksAtMainLoc - unused, unused);
+        fcb->blocksAtMainLoc -= unused;
+    }
+
+    fcb->blocksAllocated -= unused;
+    fcb->fileInfo->st_blocks = fcb->blocksAllocated;
+
+    return writeFileEntry(fcb);
+}
+
+static int64_t fileBlockToLBA(b_fcb * fcb, int64_t fileBlock, int64_t * runLeft) {
+    if (fileBlock < 0 || fileBlock >= fcb->blocksAllocated)
+        return -1;
+
+    // logarithmic lookup for files with an extent tree
+    if (usesExtentTree(fcb)) {
+        extentRecord run;
+        if (extentTreeLookup(fcb->fileInfo->st_extents[0].blockNumber, fileBlock, &run) < 0)
+            return -1;
+        if (runLeft != NULL)
+            *runLeft = run.fileBlock + run.count - fileBlock;
+        return run.blockNumber + (fileBlock - run.fileBlock);
+    }
+
+    if (fileBlock < fcb->blocksAtMainLoc) {
+        if (runLeft != NULL)
+            *runLeft = fcb->blocksAtMainLoc - fileBlock;
+        return fcb->fileInfo->st_location + fileBlock;
+    }
+    fileBlock -= fcb->blocksAtMainLoc;
+
+    for (int i = 0; i < MAX_EXTENTS; i++) {
+        extent * ext = &(fcb->fileInfo->st_extents[i]);
+        if (ext->count <= 0)
+            break;
+        if (fileBlock < ext->count) {
+            if (runLeft != NULL)
+                *runLeft = ext->count - fileBlock;
+            return ext->blockNumber + fileBlock;
+        }
+        fileBlock -= ext->count;
+    }
+    return -1;
+}
+
+static int writeFileEntry(b_fcb * fcb) {
+    // temporary block of DE buffer
+    directoryEntry * tempBlockBuf = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
+
+    int64_t blockToEditDE = -1;
+    int indexInBlock = -1;
+    if (findDirEntry(fcb->parent->location, fcb->fileInfo->st_name, NULL, &blockToEditDE, &indexInBlock) < 0) {
+        fprintf(stderr, "ERROR: Could not find the file's directory entry.\n");
         free(tempBlockBuf);
+        return -4;
     }
 
-    return bytesBuffered;               // return number of bytes that were written
+    // update entry in info volume
+    readDirBlocks(tempBlockBuf, 1, blockToEditDE);
+
+    tempBlockBuf[indexInBlock].fileSize = fcb->fileInfo->st_size;
+    tempBlockBuf[indexInBlock].location = fcb->fileInfo->st_location;
+    memcpy(tempBlockBuf[indexInBlock].extentLocations, fcb->fileInfo->st_extents, sizeof(extent) * MAX_EXTENTS);
+
+    writeDirBlocks(tempBlockBuf, 1, blockToEditDE);
+    dentryCacheInvalidate(fcb->parent->location, tempBlockBuf[indexInBlock].name);
+
+    free(tempBlockBuf);
+    return 0;
 }
 
 // Interface to read a buffer
@@ -771,13 +863,16 @@ int b_read(b_io_fd fd, char* buffer, int count) {
         fprintf(stderr, "ERROR: File not opened with Read permissions.\n");
         return -2;
     }
+
+    // delayed bytes have to reach the disk before they can be read
+    if (flushPending(fcb, 1) < 0)
+        return -3;
     
     // If file has no size, return 0
-    if (fcb->fileInfo->st_size == 0 || fcb->lbaPos < 0)
+    if (fcb->fileInfo->st_size == 0 || fcb->blocksAllocated == 0)
         return 0;
     
-    int fileLoc = fcb->fileInfo->st_location;
-    int fileSize = fcb->fileInfo->st_size;
+    off_t fileSize = fcb->fileInfo->st_size;
     int bytesBuffered = 0;
 
     // Clamp the count to be read:     min(count, fileSize - filePos)
@@ -789,43 +884,32 @@ int b_read(b_io_fd fd, char* buffer, int count) {
 
     // While there are bytes to be read
     while (count != bytesBuffered) {
+        int64_t blockInFile = (fcb->filePos + bytesBuffered) / B_CHUNK_SIZE;
+
         // If we can read entire contiguous LBAs, requires useable bytes in buffer to be 0
         int wholeLBAs = (count - bytesBuffered) / B_CHUNK_SIZE;
-        if (wholeLBAs > 0 && fcb->dataInBuffer == 0) {
-            // Check if lbaPos within range of mainLoc [main location, main location furthest block]
-            if (fcb->fileInfo->st_location <= fcb->lbaPos &&
-                fcb->lbaPos < fcb->fileInfo->st_location + fcb->blocksAtMainLoc)
-            {
-                wholeLBAs = (fcb->fileInfo->st_location + fcb->blocksAtMainLoc) - fcb->lbaPos;
-            }
-            // If lbaPos not in range of mainLoc, check each extent
-            else {
-                for (int i = 0; i < MAX_EXTENTS; i++) {
-                    extent * currExt = &(fcb->fileInfo->st_extents[i]);
-
-                    // Check if valid extent
-                    if (currExt->count > 0 &&
-                        // Check if lbaPos within range of extent [extent location, extent location furthest block]
-                        currExt->blockNumber <= fcb->lbaPos &&
-                        fcb->lbaPos < currExt->blockNumber + currExt->count)
-                    {
-                        wholeLBAs = (currExt->blockNumber + currExt->count) - fcb->lbaPos;
-                        break;
-                    }
-                }
-            }
+        if (wholeLBAs > 0 && fcb->dataInBuffer == 0 && fcb->index == 0) {
+            // never more than asked for, never past the end of the run
+            int64_t runLeft = 0;
+            int64_t lba = fileBlockToLBA(fcb, blockInFile, &runLeft);
+            if (lba < 0)
+                break;
+            if (runLeft < wholeLBAs)
+                wholeLBAs = runLeft;
 
-            fcb->lbaPos += LBAread(buffer + bytesBuffered, wholeLBAs, fcb->lbaPos);
+            cachedLBAread(buffer + bytesBuffered, wholeLBAs, lba);
             bytesBuffered += wholeLBAs * B_CHUNK_SIZE;
         }
         else {
             // Read a block if buffer has no bytes
-            if (fileSize - (bytesBuffered + fcb->filePos) > 0 && fcb->dataInBuffer == 0) {
-                fcb->lbaPos += LBAread(fcb->buff, 1, fcb->lbaPos);
+            if (fcb->dataInBuffer == 0) {
+                fcb->lbaPos = fileBlockToLBA(fcb, blockInFile, NULL);
+                if (fcb->lbaPos < 0)
+                    break;
+                cachedLBAread(fcb->buff, 1, fcb->lbaPos);
                 fcb->dataInBuffer = 1;
             }
 
-
             // bytes to memcpy is default bytes left to read
 			// but if amount left to read is greater than chunk size
 			// then change to difference of chunk size and buffer pos
@@ -845,24 +929,6 @@ int b_read(b_io_fd fd, char* buffer, int count) {
                 fcb->index  = 0;    // reset buffer position to 0
             }
         }
-
-        // check if lbaPos is 1 above useable blocks
-        for (int i = -1; i < MAX_EXTENTS; i++) {
-            // if 1 above main location, set location to first extent
-            if (i == -1 &&
-                fcb->lbaPos == fcb->fileInfo->st_location + fcb->blocksAtMainLoc)
-            {
-                fcb->lbaPos = fcb->fileInfo->st_extents[i + 1].blockNumber;
-                break;
-            }
-            // except for last extent, if 1 above extent, set location to next extent
-            else if (i < MAX_EXTENTS - 1 &&
-                fcb->lbaPos == fcb->fileInfo->st_extents[i].blockNumber + fcb->fileInfo->st_extents[i].count)
-            {
-                fcb->lbaPos = fcb->fileInfo->st_extents[i + 1].blockNumber;
-                break;
-            }
-        }
     }
 
     fcb->filePos += bytesBuffered;      // update total number of bytes read
@@ -880,6 +946,17 @@ int b_close(b_io_fd fd) {
 
     b_fcb * fcb = &(fcbArray[fd]);  // Current FCB
 
+    // delayed allocation happens here at the latest, and the reserve past EOF is returned
+    int result = 0;
+    if (fcb->buff != NULL && fcb->fileInfo != NULL) {
+        result = flushPending(fcb, 0);
+        if (trimReserved(fcb) < 0)
+            result = -3;
+    }
+
+    if (fcb->pending != NULL)
+        free(fcb->pending);
+
     if (fcb->buff != NULL)
         free(fcb->buff);        // Free buffer
     
@@ -895,4 +972,114 @@ int b_close(b_io_fd fd) {
     fcb->lbaPos     = -1;
     fcb->filePos    = 0;
     fcb->index      = 0;
+    fcb->pending    = NULL;
+    fcb->pendingLen = 0;
+    fcb->pendingCap = 0;
+    fcb->blocksReserved = 0;
+
+    return result;
+}
+
+// Interface to preallocate blocks for a file
+// Reserves [offset, offset + len) as one contiguous run without zero-filling it;
+// the file size is not changed, so none of the old block contents can be read
+int b_fallocate(b_io_fd fd, off_t offset, off_t len) {
+    if (startup == 0) b_init();  // Initialize our system
+
+    // check that fd is between 0 and (MAXFCBS-1)
+    if ((fd < 0) || (fd >= MAXFCBS)) {
+        fprintf(stderr, "ERROR: Invalid file descriptor.\n");
+        return (-1);  // invalid file descriptor
+    }
+
+    b_fcb * fcb = &(fcbArray[fd]);  // Current FCB
+
+    // Check if FD is valid (if buffer exists)
+    if (fcb->buff == NULL || fcb->fileInfo == NULL) {
+        fprintf(stderr, "ERROR: Invalid file descriptor.\n");
+        return -1;
+    }
+
+    // Check if FD opened with neither WriteOnly or ReadWrite
+    if ( !(fcb->flagRDWR & (O_WRONLY | O_RDWR)) || offset < 0 || len <= 0) {
+        fprintf(stderr, "ERROR: File not opened with Write permissions OR invalid range.\n");
+        return -2;
+    }
+
+    // pending bytes get their blocks first so the new run follows them
+    if (flushPending(fcb, 0) < 0)
+        return -3;
+
+    // an explicit reservation keeps any speculative blocks it builds on
+    fcb->blocksReserved = 0;
+
+    int64_t blocksWanted = (offset + len + B_CHUNK_SIZE - 1) / B_CHUNK_SIZE;
+    if (blocksWanted <= fcb->blocksAllocated)
+        return 0;
+
+    int64_t blocksNeeded = blocksWanted - fcb->blocksAllocated;
+    extent * extents = fcb->fileInfo->st_extents;
+
+    // Empty file: the run is both the main location and extent 0
+    if (fcb->blocksAllocated == 0) {
+        int64_t runStart = allocateBlocksNear(blocksNeeded, fcb->parent->location);
+        if (runStart < 0) {
+            fprintf(stderr, "ERROR: Could not allocate blocks for preallocation.\n");
+            return -3;
+        }
+
+        fcb->fileInfo->st_location = runStart;
+        extents[0].blockNumber = runStart;
+        extents[0].count = blocksNeeded;
+
+        fcb->lbaPos = runStart;
+        fcb->index = 0;
+        fcb->dataInBuffer = 0;
+    }
+    else {
+        // The DE has no field for the length of the main location, so move
+        // that run into extent 0 (or an extent tree) before blocks past the file size exist
+        if (!usesExtentTree(fcb) && fcb->blocksAtMainLoc > 0) {
+            if (extents[MAX_EXTENTS - 1].count > 0) {
+                if (convertToExtentTree(fcb) < 0)
+                    return -3;
+            }
+            else {
+                memmove(&extents[1], &extents[0], sizeof(extent) * (MAX_EXTENTS - 1));
+                extents[0].blockNumber = fcb->fileInfo->st_location;
+                extents[0].count = fcb->blocksAtMainLoc;
+                fcb->blocksAtMainLoc = 0;
+            }
+        }
+
+        // grows the last run in place when possible, otherwise adds one run
+        if (growFile(fcb, blocksNeeded) < 0) {
+            fprintf(stderr, "ERROR: Could not allocate blocks for preallocation.\n");
+            return -3;
+        }
+    }
+
+    fcb->blocksAllocated = blocksWanted;
+    fcb->fileInfo->st_blocks = blocksWanted;
+
+    return writeFileEntry(fcb);
+}
+
+// Interface to flush delayed writes without closing the file
+int b_flush(b_io_fd fd) {
+    // check that fd is between 0 and (MAXFCBS-1)
+    if ((fd < 0) || (fd >= MAXFCBS)) {
+        fprintf(stderr, "ERROR: Invalid file descriptor.\n");
+        return (-1);  // invalid file descriptor
+    }
+
+    b_fcb * fcb = &(fcbArray[fd]);  // Current FCB
+
+    // Check if FD is valid (if buffer exists)
+    if (fcb->buff == NULL || fcb->fileInfo == NULL) {
+        fprintf(stderr, "ERROR: Invalid file descriptor.\n");
+        return -1;
+    }
+
+    return flushPending(fcb, 1);
 }
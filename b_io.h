@@ -10,6 +10,8 @@ int b_read (b_io_fd fd, char * buffer, int count);
 int b_write (b_io_fd fd, char * buffer, int count);
 int b_seek (b_io_fd fd, off_t offset, int whence);
 int b_close (b_io_fd fd);
+int b_flush (b_io_fd fd);
+int b_fallocate (b_io_fd fd, off_t offset, off_t len);
 
 #endif
 
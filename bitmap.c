@@ -7,7 +7,10 @@
  * File: bitmap.c
  *
  * Description: bitmap for managing free space The map's dimensions are 
- * based on the project's maximum size, which is 19,531 blocks of 512 bytes. 
+ * based on the volume's totalBlock, one bit per block. A summary level keeps a
+ * free count for every GROUP_BLOCKS blocks so scans skip full (or empty) groups.
+ * New runs are placed best-fit through the free extent index (freeSpaceIndex.c),
+ * which is rebuilt from the map whenever it is loaded.
  *
  *
  **************************************************************/
@@ -16,8 +19,26 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "bitmapScan.h"
+#include "blockCache.h"
+#include "freeSpaceIndex.h"
 #include "fsLow.h"
 
+bitmap* bitmapPointer = NULL;
+
+// One flag per on-disk bitmap block, set when a bit inside it changes
+static char* dirtyMapBlocks = NULL;
+
+// Depth of nested beginMapTransaction() calls; flushes wait until it is 0
+static int mapTransactionDepth = 0;
+
+// 1 while setMapConcurrent() mode is on: blocks are claimed with atomic CAS
+static int concurrentAlloc = 0;
+
+// Per thread position to start searching from in concurrent mode, so
+// writers spread out over the map instead of racing for the same run
+static __thread int allocHint = 0;
+
 /* FORWARD DECLARATION BLOCK */
 
 /**
@@ -44,12 +65,51 @@ void printMap();
  */
 int findEmptyBlocks(int length, int start);
 
+// Like findEmptyBlocks() but only returns runs that end at or before limit
+static int findRunInRange(int length, int start, int limit);
+
+/**
+ * Finds a free run inside the allocation group holding goal: first at or after
+ * the goal, then anywhere else in that group.
+ * Returns -1 if the group has no run long enough.
+ */
+static int findRunNear(int length, int goal);
+
+/**
+ * Finds the first free (0) bit in [bit, limit).
+ * Groups with no free blocks are skipped using the summary level, inside a group
+ * fully allocated words are skipped by the bitmapScan kernel (256 bits per step
+ * with AVX2) and the bit inside a word is found with count-trailing-zeros.
+ *
+ * Returns the bit position, or -1 if every bit in the range is set.
+ */
+int nextFreeBit(int bit, int limit);
+
 /**
- * Recursively count the empty blocks starting from the given bit.
+ * Finds the first allocated (1) bit in [bit, limit), skipping entirely free groups.
  *
- * Returns n = length if all blocks were empty, otherwise returns n < length.
+ * Returns the bit position, or limit if every bit in the range is free.
  */
-int recursiveCount(int bit, int length);
+int nextUsedBit(int bit, int limit);
+
+// Word level scans used by nextFreeBit/nextUsedBit inside one group
+static int scanFreeBit(int bit, int limit);
+static int scanUsedBit(int bit, int limit);
+
+// Number of real blocks in a group (the last group can be short)
+static int groupSize(int group);
+
+/**
+ * Builds the in-memory map of numBlocks blocks held in mapBlocks blocks at MAP_LOCATION,
+ * read from the LBA or new and empty, for initMap() and initLegacyMap().
+ * Returns MAP_LOCATION, or -1 on memory allocation error.
+ */
+static int setupMap(int lbaReadBool, int numBlocks, int blockSize, int mapBlocks);
+
+// Reads of a map word and a group's free count for the scans: relaxed atomic loads,
+// since in concurrent mode other threads claim and release bits while a scan runs
+static inline uint32_t loadMapWord(int word);
+static inline int loadGroupFree(int group);
 
 // Set the specified bit within the map
 void setBit(int bit);
@@ -60,36 +120,148 @@ void clearBit(int bit);
 // Find the specified bit within the map
 int findBit(int bit);
 
+// Flag the bitmap blocks holding bits [start, start + length) as dirty
+void markMapDirty(int start, int length);
+
+// Flush the dirty bitmap blocks unless a transaction is open
+int persistMap();
+
+// Rebuild the free extent index from the runs of clear bits in the map
+void buildFreeIndex();
+
+/**
+ * Picks where a new run of length blocks goes: best fit from the free extent
+ * index, or a first-fit bitmap scan if the index is not built.
+ * Returns the start block, or -1 if no run is long enough.
+ */
+int findFreeRun(int length);
+
+// Returns 1 if every block in [start, start + length) is free
+int isRunFree(int start, int length);
+
+/**
+ * Concurrent mode: atomically sets every bit in [start, start + length).
+ * Each word is claimed with compare-and-swap; if any bit in the range is
+ * already set the words claimed so far are released again.
+ * Returns 0 if the whole range was claimed, -1 otherwise.
+ */
+static int claimRange(int start, int length);
+
+// Concurrent mode: finds a free run from hint on and claims it, retrying past lost races
+static int claimFreeRun(int length, int hint);
+
+// Concurrent mode: atomically clears bits without touching the summary level
+static void releaseBits(int start, int length);
+
+// Concurrent mode: atomically adds delta per block to the groups covering the range
+static void adjustGroups(int start, int length, int delta);
+
 /* FORWARD DECLARATION BLOCK END*/
 
 
-int initMap(int lbaReadBool) {
-    //block size 512 * 5 blocks = bytes
-    bitmapPointer = calloc(1, (5 * MINBLOCKSIZE));
+int mapBlocksFor(int totalBlocks, int blockSize) {
+    int bytes = (totalBlocks + 7) / 8;
+    return (bytes + blockSize - 1) / blockSize;
+}
+
+int initMap(int lbaReadBool, int totalBlocks, int blockSize) {
+    return setupMap(lbaReadBool, totalBlocks, blockSize, mapBlocksFor(totalBlocks, blockSize));
+}
+
+int initLegacyMap(int totalBlocks, int blockSize) {
+    // the v1 map never grew with the volume: blocks past what it covers are never handed out
+    int numBlocks = (totalBlocks < V1_MAP_BITS) ? totalBlocks : V1_MAP_BITS;
+    return setupMap(1, numBlocks, blockSize, V1_MAP_BLOCKS);
+}
+
+static int setupMap(int lbaReadBool, int numBlocks, int blockSize, int mapBlocks) {
+    bitmapPointer = calloc(1, sizeof(bitmap));
     if (bitmapPointer == NULL) {
         fprintf(stderr, "Memory Allocation Error");
         return -1;
     }
+
+    bitmapPointer->numBlocks = numBlocks;
+    bitmapPointer->blockSize = blockSize;
+    bitmapPointer->mapBlocks = mapBlocks;
+    bitmapPointer->numWords = (bitmapPointer->mapBlocks * blockSize) / sizeof(uint32_t);
+    bitmapPointer->numGroups = (numBlocks + GROUP_BLOCKS - 1) / GROUP_BLOCKS;
+
+    // whole blocks so the map can be read and written straight from memory
+    bitmapPointer->map = calloc(bitmapPointer->mapBlocks, blockSize);
+    bitmapPointer->groupFree = calloc(bitmapPointer->numGroups, sizeof(unsigned short));
+    dirtyMapBlocks = calloc(bitmapPointer->mapBlocks, sizeof(char));
+    if (bitmapPointer->map == NULL || bitmapPointer->groupFree == NULL || dirtyMapBlocks == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        freeMap();
+        return -1;
+    }
+
     //if reading from the LBA
     if (lbaReadBool) {
-        LBAread(bitmapPointer,5,1);
+        cachedLBAread(bitmapPointer->map, bitmapPointer->mapBlocks, MAP_LOCATION);
+
+        // bits past the last block mean nothing, a v1 map has room for more blocks than it covers
+        int lastWord = INT_OFFSET(numBlocks);
+        if (BIT_OFFSET(numBlocks) != 0)
+            bitmapPointer->map[lastWord++] &= ((uint32_t)1 << BIT_OFFSET(numBlocks)) - 1;
+        for (int w = lastWord; w < bitmapPointer->numWords; w++)
+            bitmapPointer->map[w] = 0;
+
+        // rebuild the summary level from the leaf bits
+        for (int g = 0; g < bitmapPointer->numGroups; g++) {
+            int firstWord = g * (GROUP_BLOCKS / BITS_PER_UINT);
+            int words = GROUP_BLOCKS / BITS_PER_UINT;
+            if (firstWord + words > bitmapPointer->numWords)
+                words = bitmapPointer->numWords - firstWord;
+            bitmapPointer->groupFree[g] = groupSize(g) - countSetBits(bitmapPointer->map + firstWord, words);
+        }
 
     //otherwise zero bitmap memory and allocate space for self
     } else {
-        for (int i = 0; i < NUM_BLOCKS - 1; i++) {
-            clearBit(i);
+        for (int g = 0; g < bitmapPointer->numGroups; g++) {
+            bitmapPointer->groupFree[g] = groupSize(g);
         }
-        //writing 5 blocks for bitmap's own memory
-        writeBlocks(1, 5);
-        LBAwrite(bitmapPointer, 5, 1);
+        //writing the blocks for bitmap's own memory
+        writeBlocks(MAP_LOCATION, bitmapPointer->mapBlocks);
+
+        // brand new map: every block has to reach the disk once
+        markMapDirty(0, numBlocks);
+        persistMap();
     }
 
-    return 1;
+    buildFreeIndex();
+    return MAP_LOCATION;
+}
+
+static int groupSize(int group) {
+    int size = bitmapPointer->numBlocks - group * GROUP_BLOCKS;
+    return (size < GROUP_BLOCKS) ? size : GROUP_BLOCKS;
+}
+
+void buildFreeIndex() {
+    resetFreeIndex();
+
+    int i = 0;
+    while ((i = nextFreeBit(i, bitmapPointer->numBlocks)) >= 0) {
+        int runEnd = nextUsedBit(i, bitmapPointer->numBlocks);
+        indexMarkFree(i, runEnd - i);
+        i = runEnd;
+    }
 }
 
 int freeMap() {
     if (bitmapPointer != NULL) {
+        // anything left behind by an unfinished transaction
+        mapTransactionDepth = 0;
+        if (bitmapPointer->map != NULL && dirtyMapBlocks != NULL)
+            flushMap();
+        freeFreeIndex();
+        free(bitmapPointer->map);
+        free(bitmapPointer->groupFree);
+        free(dirtyMapBlocks);
         free(bitmapPointer);
+        dirtyMapBlocks = NULL;
         bitmapPointer = NULL;
         return 0;
     }
@@ -97,23 +269,46 @@ int freeMap() {
     return -1;
 }
 
+int findFreeRun(int length) {
+    if (freeIndexReady())
+        return indexBestFit(length);
+    return findEmptyBlocks(length, 0);
+}
+
+int isRunFree(int start, int length) {
+    if (start < 0 || length <= 0 || start + length > bitmapPointer->numBlocks)
+        return 0;
+    return nextUsedBit(start, start + length) == start + length;
+}
+
 int allocateFirstBlocks(int length) {
-    int blockPos = findEmptyBlocks(length, 0);
+    return allocateBlocksNear(length, -1);
+}
+
+int allocateBlocksNear(int length, int goal) {
+    int blockPos;
+    if (concurrentAlloc) {
+        blockPos = claimFreeRun(length, goal);
+    } else {
+        // stay in the goal's group if it has room, otherwise best fit over the whole volume
+        blockPos = findRunNear(length, goal);
+        if (blockPos < 0)
+            blockPos = findFreeRun(length);
+        if (blockPos >= 0)
+            writeBlocks(blockPos, length);
+    }
+
     if (blockPos < 0) {
         fprintf(stderr, "ERROR: no free space found");
         return -1;
     }
 
-    writeBlocks(blockPos, length);
-    LBAwrite(bitmapPointer, 5, 1);
+    persistMap();
     return blockPos;
 }
 
-int allocateAdditionalBlocks(int location, int initialSize, int additionalSize, extent* extentArray) {
-    // TODO
-    // Finish comments for this function
-
-    //check if extents have non-zero count
+int allocateAdditionalBlocks(int location, int initialSize, int additionalSize, extent extentArray[3]) {
+    // the last extent in use, if any, is where the file ends
     int lastNonZeroIndex = -1;
     int usingExtents = 0;
     for (int i = 2; i >= 0; --i) {
@@ -123,17 +318,34 @@ int allocateAdditionalBlocks(int location, int initialSize, int additionalSize,
         }
     }
 
-    // Set startLocation to the block thats either a non-zero index from an extent or the location of the end of the regular allocated block
+    // the block right after the file: after its last extent, or after its first run when it has none
     int startLocation = (lastNonZeroIndex != -1) ? ((int)extentArray[lastNonZeroIndex].blockNumber + extentArray[lastNonZeroIndex].count) : (location + initialSize);
 
-    //
-    int blockPos = findEmptyBlocks(additionalSize, startLocation);
-    if (blockPos == startLocation) {
+    // in concurrent mode checking and claiming the blocks right after the file is one atomic step
+    int grewInPlace = concurrentAlloc ? (claimRange(startLocation, additionalSize) == 0)
+                                      : isRunFree(startLocation, additionalSize);
+
+    int blockPos = -1;
+    if (grewInPlace) {
+        blockPos = startLocation;
         if (lastNonZeroIndex != -1) {
             extentArray[lastNonZeroIndex].count += additionalSize;
         }
     } else {
-        blockPos = findEmptyBlocks(additionalSize, 0);
+        // every extent slot is taken, there is nowhere to record a new run
+        if (lastNonZeroIndex == 2) {
+            fprintf(stderr, "ERROR: no free extent left\n");
+            return -1;
+        }
+
+        // the new extent goes as close to the end of the file as possible
+        if (concurrentAlloc) {
+            blockPos = claimFreeRun(additionalSize, startLocation);
+        } else {
+            blockPos = findRunNear(additionalSize, startLocation);
+            if (blockPos < 0)
+                blockPos = findFreeRun(additionalSize);
+        }
         if (blockPos < 0) {
             fprintf(stderr, "ERROR: no free space found");
             return -1;
@@ -142,79 +354,363 @@ int allocateAdditionalBlocks(int location, int initialSize, int additionalSize,
         extentArray[lastNonZeroIndex + 1].blockNumber = blockPos;
         extentArray[lastNonZeroIndex + 1].count = additionalSize;
     }
-    if (blockPos < 0) {
-        fprintf(stderr, "ERROR: no free space found");
-        return -1;
-    }
-    writeBlocks(blockPos, additionalSize);
-    LBAwrite(bitmapPointer, 5, 1);
+    if (!concurrentAlloc)
+        writeBlocks(blockPos, additionalSize);
+    persistMap();
     return usingExtents;
 }
 
 int writeBlocks(int start, int length) {
-    if (start + length > NUM_BLOCKS) {
+    if (start + length > bitmapPointer->numBlocks) {
         printf("Trying to set bits exceeding number of blocks");
         return -1;
     }
     for (int i = start; i < (start + length); i++) {
         setBit(i);
     }
+    markMapDirty(start, length);
+    indexMarkUsed(start, length);
     return 0;
 }
 
 int clearBlocks(int start, int length) {
-    if (start + length > NUM_BLOCKS) {
+    if (start + length > bitmapPointer->numBlocks) {
         fprintf(stderr, "Trying to clear bits exceeding number of blocks\n");
 
         return -1;
     }
+
+    if (concurrentAlloc) {
+        releaseBits(start, length);
+        adjustGroups(start, length, 1);
+        markMapDirty(start, length);
+        return 0;
+    }
+
     // clears the bits in the initial location
     for (int i = start; i < (start + length); i++) {
         clearBit(i);
     }
-    LBAwrite(bitmapPointer, 5, 1);
+    markMapDirty(start, length);
+    indexMarkFree(start, length);
+    persistMap();
     return 0;
 }
 
-int findEmptyBlocks(int length, int start) {
-    int i = start;
-    while (i < NUM_BLOCKS - 1) {
-        if (findBit(i) == 0) {
-            int foundLength = recursiveCount(i, length);
-            if (foundLength == length) {
-                return i;
-            } else {
-                // Skip the checked bits
-                i += (foundLength > 0) ? foundLength : 1;
+void setMapConcurrent(int enable) {
+    if (enable && !concurrentAlloc) {
+        // the free extent index is not thread safe, concurrent allocations scan the map,
+        // with the scalar kernels: a vector load is not an atomic read of each word
+        freeFreeIndex();
+        setScanScalar(1);
+        concurrentAlloc = 1;
+    } else if (!enable && concurrentAlloc) {
+        concurrentAlloc = 0;
+        setScanScalar(0);
+        buildFreeIndex();
+        persistMap();
+    }
+}
+
+// Mask of count bits starting at offset within one word
+static inline uint32_t rangeMask(int offset, int count) {
+    uint32_t bits = (count >= (int)BITS_PER_UINT) ? ~(uint32_t)0 : (((uint32_t)1 << count) - 1);
+    return bits << offset;
+}
+
+static int claimRange(int start, int length) {
+    if (start < 0 || length <= 0 || start + length > bitmapPointer->numBlocks)
+        return -1;
+
+    int end = start + length;
+    int bit = start;
+    while (bit < end) {
+        int word = INT_OFFSET(bit);
+        int wordEnd = (word + 1) * BITS_PER_UINT;
+        if (wordEnd > end)
+            wordEnd = end;
+
+        uint32_t* target = &bitmapPointer->map[word];
+        uint32_t mask = rangeMask(BIT_OFFSET(bit), wordEnd - bit);
+        uint32_t old = __atomic_load_n(target, __ATOMIC_RELAXED);
+        do {
+            if (old & mask) {
+                // another writer owns part of the range, give back what we took
+                if (bit > start)
+                    releaseBits(start, bit - start);
+                return -1;
             }
-        } else {
-            i++;
+            // a failed CAS reloads old; retry as long as our bits are still clear
+        } while (!__atomic_compare_exchange_n(target, &old, old | mask, 1, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+        bit = wordEnd;
+    }
+
+    adjustGroups(start, length, -1);
+    markMapDirty(start, length);
+    return 0;
+}
+
+static int claimFreeRun(int length, int hint) {
+    int numBlocks = bitmapPointer->numBlocks;
+    if (hint < 0 || hint >= numBlocks)
+        hint = (allocHint > 0 && allocHint < numBlocks) ? allocHint : 0;
+
+    // search from the hint to the end, then wrap around to the start
+    for (int pass = 0; pass < 2; pass++) {
+        int from = (pass == 0) ? hint : 0;
+        int stop = (pass == 0) ? numBlocks : hint + length;
+
+        // the scan's relaxed loads only pick a candidate; claimRange() is what decides ownership
+        int pos;
+        while ((pos = findEmptyBlocks(length, from)) >= 0 && pos < stop) {
+            if (claimRange(pos, length) == 0) {
+                allocHint = pos + length;
+                return pos;
+            }
+            from = pos + 1;  // lost the race for this run, keep looking past it
         }
+
+        if (hint == 0)
+            break;
     }
     return -1;
 }
 
-int recursiveCount(int bit, int length) {
-    if (length == 0) {
+static void releaseBits(int start, int length) {
+    int end = start + length;
+    int bit = start;
+    while (bit < end) {
+        int word = INT_OFFSET(bit);
+        int wordEnd = (word + 1) * BITS_PER_UINT;
+        if (wordEnd > end)
+            wordEnd = end;
+
+        __atomic_fetch_and(&bitmapPointer->map[word], ~rangeMask(BIT_OFFSET(bit), wordEnd - bit), __ATOMIC_RELEASE);
+        bit = wordEnd;
+    }
+}
+
+static void adjustGroups(int start, int length, int delta) {
+    int end = start + length;
+    int bit = start;
+    while (bit < end) {
+        int group = bit / GROUP_BLOCKS;
+        int groupEnd = (group + 1) * GROUP_BLOCKS;
+        if (groupEnd > end)
+            groupEnd = end;
+
+        int change = delta * (groupEnd - bit);
+        __atomic_fetch_add(&bitmapPointer->groupFree[group], (unsigned short)change, __ATOMIC_RELAXED);
+        bit = groupEnd;
+    }
+}
+
+void markMapDirty(int start, int length) {
+    if (length <= 0)
+        return;
+
+    // byte offset of the first/last changed bit -> bitmap block holding it
+    int firstBlock = (start / 8) / bitmapPointer->blockSize;
+    int lastBlock = ((start + length - 1) / 8) / bitmapPointer->blockSize;
+    for (int b = firstBlock; b <= lastBlock && b < bitmapPointer->mapBlocks; b++) {
+        __atomic_store_n(&dirtyMapBlocks[b], 1, __ATOMIC_RELAXED);
+    }
+}
+
+int flushMap() {
+    int result = 0;
+    int b = 0;
+    while (b < bitmapPointer->mapBlocks) {
+        if (!dirtyMapBlocks[b]) {
+            b++;
+            continue;
+        }
+
+        // merge the run of dirty blocks into a single write
+        int runEnd = b;
+        while (runEnd < bitmapPointer->mapBlocks && dirtyMapBlocks[runEnd]) {
+            dirtyMapBlocks[runEnd] = 0;
+            runEnd++;
+        }
+
+        char* blockStart = (char*)bitmapPointer->map + (b * bitmapPointer->blockSize);
+        if (cachedLBAwrite(blockStart, runEnd - b, MAP_LOCATION + b) != (uint64_t)(runEnd - b))
+            result = -1;
+        b = runEnd;
+    }
+    return result;
+}
+
+int persistMap() {
+    // concurrent writers defer to setMapConcurrent(0); the LBA layer is single threaded
+    if (mapTransactionDepth > 0 || concurrentAlloc)
         return 0;
-    } else if (findBit(bit) == 0) {
-        return recursiveCount((bit + 1), length - 1) + 1;
-    } else {
-        // Return the number of consecutive empty bits found
-        return length - 1;
+    return flushMap();
+}
+
+void beginMapTransaction() {
+    mapTransactionDepth++;
+}
+
+int endMapTransaction() {
+    if (mapTransactionDepth > 0)
+        mapTransactionDepth--;
+    return persistMap();
+}
+
+int findEmptyBlocks(int length, int start) {
+    return findRunInRange(length, start, bitmapPointer->numBlocks);
+}
+
+static int findRunInRange(int length, int start, int limit) {
+    if (length <= 0 || start < 0)
+        return -1;
+
+    int i = start;
+    while (i < limit) {
+        // jump to the next free block
+        i = nextFreeBit(i, limit);
+        if (i < 0 || i + length > limit)
+            return -1;
+
+        // the run ends at the next used block; only look as far as we need
+        int runEnd = nextUsedBit(i, i + length);
+        if (runEnd - i == length)
+            return i;
+
+        // every bit before runEnd was free but too short, resume after it
+        i = runEnd;
+    }
+    return -1;
+}
+
+static int findRunNear(int length, int goal) {
+    if (goal < 0 || goal >= bitmapPointer->numBlocks)
+        return -1;
+
+    int group = goal / GROUP_BLOCKS;
+    int groupStart = group * GROUP_BLOCKS;
+    int groupEnd = groupStart + groupSize(group);
+    if (loadGroupFree(group) < length)
+        return -1;
+
+    int pos = findRunInRange(length, goal, groupEnd);
+    if (pos < 0)
+        pos = findRunInRange(length, groupStart, groupEnd);
+    return pos;
+}
+
+int nextFreeBit(int bit, int limit) {
+    while (bit < limit) {
+        int group = bit / GROUP_BLOCKS;
+        int groupEnd = (group + 1) * GROUP_BLOCKS;
+        if (groupEnd > limit)
+            groupEnd = limit;
+
+        // summary level says the whole group is allocated
+        if (loadGroupFree(group) != 0) {
+            int found = scanFreeBit(bit, groupEnd);
+            if (found >= 0)
+                return found;
+        }
+        bit = groupEnd;
+    }
+    return -1;
+}
+
+int nextUsedBit(int bit, int limit) {
+    while (bit < limit) {
+        int group = bit / GROUP_BLOCKS;
+        int groupEnd = (group + 1) * GROUP_BLOCKS;
+        if (groupEnd > limit)
+            groupEnd = limit;
+
+        // summary level says the whole group is free
+        if (loadGroupFree(group) != groupSize(group)) {
+            int found = scanUsedBit(bit, groupEnd);
+            if (found < groupEnd)
+                return found;
+        }
+        bit = groupEnd;
+    }
+    return limit;
+}
+
+static int scanFreeBit(int bit, int limit) {
+    if (bit >= limit)
+        return -1;
+
+    int word = INT_OFFSET(bit);
+    int lastWord = INT_OFFSET(limit - 1);
+
+    // free bits of the first word, ignoring those below the start bit
+    uint32_t freeBits = ~loadMapWord(word) & (~(uint32_t)0 << BIT_OFFSET(bit));
+    if (freeBits == 0) {
+        // let the vector kernel skip the fully allocated words
+        word = scanNonFullWord(bitmapPointer->map, word + 1, lastWord + 1);
+        if (word > lastWord)
+            return -1;
+        freeBits = ~loadMapWord(word);
+    }
+
+    int found = word * BITS_PER_UINT + __builtin_ctz(freeBits);
+    return (found < limit) ? found : -1;
+}
+
+static int scanUsedBit(int bit, int limit) {
+    if (bit >= limit)
+        return limit;
+
+    int word = INT_OFFSET(bit);
+    int lastWord = INT_OFFSET(limit - 1);
+
+    uint32_t usedBits = loadMapWord(word) & (~(uint32_t)0 << BIT_OFFSET(bit));
+    if (usedBits == 0) {
+        // long free runs: skip the empty words with the vector kernel
+        word = scanNonEmptyWord(bitmapPointer->map, word + 1, lastWord + 1);
+        if (word > lastWord)
+            return limit;
+        usedBits = loadMapWord(word);
+    }
+
+    int found = word * BITS_PER_UINT + __builtin_ctz(usedBits);
+    return (found < limit) ? found : limit;
+}
+
+static inline uint32_t loadMapWord(int word) {
+    return __atomic_load_n(&bitmapPointer->map[word], __ATOMIC_RELAXED);
+}
+
+static inline int loadGroupFree(int group) {
+    return __atomic_load_n(&bitmapPointer->groupFree[group], __ATOMIC_RELAXED);
+}
+
+int countFreeBlocks() {
+    // the summary level already holds the answer per group
+    int freeBlocks = 0;
+    for (int g = 0; g < bitmapPointer->numGroups; g++) {
+        freeBlocks += loadGroupFree(g);
     }
+    return freeBlocks;
 }
 
 void setBit(int bit) {
     // takes the value from the map (with the correct offset for integer)
     // and uses an OR operation to set a specific bit (that corresponds to a block)
     // << is a LEFT SHIFT operation effectively multiplying bit * 2^1
-    bitmapPointer->map[INT_OFFSET(bit)] |= ((uint32_t)1 << BIT_OFFSET(bit));
+    uint32_t mask = (uint32_t)1 << BIT_OFFSET(bit);
+    if (!(bitmapPointer->map[INT_OFFSET(bit)] & mask))
+        bitmapPointer->groupFree[bit / GROUP_BLOCKS]--;
+    bitmapPointer->map[INT_OFFSET(bit)] |= mask;
 }
 
 void clearBit(int bit) {
     // same as above but uses an AND operation (and one's complement) to clear the bit
-    bitmapPointer->map[INT_OFFSET(bit)] &= ~((uint32_t)1 << BIT_OFFSET(bit));
+    uint32_t mask = (uint32_t)1 << BIT_OFFSET(bit);
+    if (bitmapPointer->map[INT_OFFSET(bit)] & mask)
+        bitmapPointer->groupFree[bit / GROUP_BLOCKS]++;
+    bitmapPointer->map[INT_OFFSET(bit)] &= ~mask;
 }
 
 int findBit(int bit) {
@@ -227,7 +723,7 @@ int findBit(int bit) {
 }
 
 void printMap() {
-    for (int m = 0; m < (NUM_BLOCKS / 32); m++) {
+    for (int m = 0; m < (bitmapPointer->numBlocks / 32); m++) {
         printf("m: " PRINTF_BINARY_PATTERN_INT32 "\n",
                PRINTF_BYTE_TO_BINARY_INT32(bitmapPointer->map[m]));
     }
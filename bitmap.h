@@ -8,6 +8,7 @@
  *
  * Description: Header file for the bitmap, includes exposed functions: initMap(), freeMap(), 
  * allocateFirstBlocks(), allocateAdditionalBlocks, and the structure 
+ * The map is sized from the volume, with a per-group summary level on top of the leaf bits.
  * 
  * 
  *
@@ -17,7 +18,16 @@
 
 #include <stdint.h>
 
-#define NUM_BLOCKS 19531
+// On-disk location of the bitmap, its size in blocks follows from the volume size
+#define MAP_LOCATION 1
+
+// Fixed bitmap of v1 volumes: 5 blocks at MAP_LOCATION covering the first 19531 blocks,
+// with the root directory right after it whatever the size of the volume
+#define V1_MAP_BLOCKS 5
+#define V1_MAP_BITS 19531
+
+// Blocks summarized by one entry of the group level (groupFree)
+#define GROUP_BLOCKS 4096
 
 // Calculate the number of bits in a uint32_t
 #define BITS_PER_UINT (sizeof(uint32_t) * 8)
@@ -61,27 +71,59 @@
 
 
 typedef struct bitmap {
-    // Bitmap stores 19531 bits, represented by 611 uint32_t values
-    uint32_t map[(NUM_BLOCKS/32) + 1]; 
+    // Leaf level: one bit per block, exactly what is stored on disk at MAP_LOCATION
+    uint32_t* map;
+
+    // Summary level: free block count of every GROUP_BLOCKS-block group, lets the
+    // allocator skip full groups without touching their leaf bits (memory only)
+    unsigned short* groupFree;
+
+    int numBlocks;  // blocks tracked by the map (VCB totalBlock, at most V1_MAP_BITS on v1)
+    int numWords;   // uint32_t words in map
+    int numGroups;  // entries in groupFree
+    int mapBlocks;  // blocks the map occupies on disk
+    int blockSize;  // bytes per block
 } bitmap;
 
 typedef struct extent{
-    short blockNumber;  // block start location
-    short count;  // length of the entry
+    int64_t blockNumber;  // block start location
+    int64_t count;  // length of the entry
 }extent;
 
-bitmap* bitmapPointer;
+extern bitmap* bitmapPointer;
 
 /**
- * Initializes the block bitmap and reserves the first five blocks for it.
+ * Initializes the block bitmap, sized for the volume, and reserves the blocks it occupies.
  * Allocates memory for the bitmap and sets all bits to 0, indicating that blocks are free.
  * Writes the bitmap to the LBA if not already existing
  * 
  * @param lbaReadBool 0 if bitmap does not exist in LBA, 1 if it does and should be read from the LBA
+ * @param totalBlocks number of blocks in the volume (VCB totalBlock)
+ * @param blockSize size of one block in bytes (VCB blockSize)
+ *
+ * @return The location of the bitmap in the LBA, -1 on memory allocation error.
+ */
+int initMap(int lbaReadBool, int totalBlocks, int blockSize);
+
+/**
+ * Loads the bitmap of a v1 volume, which has the fixed V1_MAP_BLOCKS blocks whatever
+ * the volume size: only the first V1_MAP_BITS blocks (or all, on a smaller volume) are
+ * tracked, so nothing past them is handed out and no map write reaches the root directory.
+ *
+ * @param totalBlocks number of blocks in the volume (VCB totalBlock)
+ * @param blockSize size of one block in bytes (VCB blockSize)
  *
  * @return The location of the bitmap in the LBA, -1 on memory allocation error.
  */
-int initMap(int lbaReadBool);
+int initLegacyMap(int totalBlocks, int blockSize);
+
+/**
+ * Number of blocks needed on disk for the bitmap of a volume.
+ *
+ * @param totalBlocks number of blocks in the volume
+ * @param blockSize size of one block in bytes
+ */
+int mapBlocksFor(int totalBlocks, int blockSize);
 
 /**
  * Frees the memory allocated for the block bitmap and sets the pointer to NULL.
@@ -91,8 +133,33 @@ int initMap(int lbaReadBool);
 int freeMap();
 
 /**
- * Allocates a contiguous sequence of new blocks of the specified length.
- * Writes the allocated blocks to the bitmap and writes to the LBA.
+ * Writes the bitmap blocks modified since the last flush to the LBA.
+ * Only the map blocks containing changed bits are written, neighbouring
+ * dirty blocks are merged into one write. Does nothing inside a transaction.
+ *
+ * @return 0 on success, -1 if a write came up short.
+ */
+int flushMap();
+
+/**
+ * Starts a bitmap transaction: allocations and frees made until the matching
+ * endMapTransaction() only touch memory, and the dirty blocks are written once
+ * at the end. Transactions may be nested, the outermost end flushes.
+ */
+void beginMapTransaction();
+
+/**
+ * Ends a bitmap transaction started with beginMapTransaction() and, for the
+ * outermost one, writes the dirty bitmap blocks.
+ *
+ * @return 0 on success, -1 if the flush failed.
+ */
+int endMapTransaction();
+
+/**
+ * Allocates a contiguous sequence of new blocks of the specified length,
+ * using the smallest free run that fits (best fit).
+ * Writes the allocated blocks to the bitmap and writes the changed bitmap blocks to the LBA.
  *
  * @param length The number of contiguous blocks to be allocated.
  *
@@ -100,11 +167,26 @@ int freeMap();
  */
 int allocateFirstBlocks( int length );
 
+/**
+ * Allocates length contiguous blocks close to a goal block. The volume is split
+ * into allocation groups of GROUP_BLOCKS blocks; the group holding goal is tried
+ * first (from the goal forward, then the rest of the group) and only if it has
+ * no run long enough does this fall back to best fit over the whole volume.
+ * Callers pass their parent directory's location so that a directory, its
+ * children and their data stay close together on disk.
+ *
+ * @param length The number of contiguous blocks to be allocated.
+ * @param goal   Block to allocate near, or -1 for no preference (same as allocateFirstBlocks()).
+ *
+ * @return The starting block position of the allocated blocks, or -1 if no free space is found.
+ */
+int allocateBlocksNear(int length, int goal);
+
 /**
  * Allocates additional contiguous blocks to extend a previously allocated set of blocks.
  * If the additional blocks cannot be found right after the existing blocks, a new extent is used.
  * If extents are needed, the extent array is updated with the new extent's starting block number and count of blocks.
- * Finally, writes to the LBA
+ * Finally, writes the changed bitmap blocks to the LBA
  *
  * @param location      The starting block number of the previously allocated set of blocks.
  * @param initialSize   The initial size of the previously allocated set of blocks (non-extent size).
@@ -112,14 +194,38 @@ int allocateFirstBlocks( int length );
  * @param extentArray   A pointer to an extent array that will be updated with the new extent.
  *                      The array should have at least 3 elements.
  *
+ * If the blocks cannot be added right after the file, the new extent is placed
+ * in the same allocation group as the end of the file when possible.
+ *
  * @return 0 if the additional blocks are allocated without using extents, 1 otherwise.
  * The returned value is not always an error code but function will return -1 if allocation fails.
  */
 int allocateAdditionalBlocks(int location, int initialSize, int additionalSize, extent extentArray[3]);
 
+/**
+ * Turns concurrent allocation mode on or off.
+ *
+ * While on, allocateFirstBlocks(), allocateAdditionalBlocks() and clearBlocks()
+ * may be called from several threads at once with no lock: blocks are claimed
+ * by compare-and-swap on the map words, so a block is never handed out twice.
+ * The free extent index is dropped (allocations scan the map) and changed
+ * bitmap blocks are only written to the LBA when the mode is turned off.
+ * Switching modes itself must not race with allocations.
+ *
+ * @param enable 1 to enter concurrent mode, 0 to leave it (rebuilds the index and flushes)
+ */
+void setMapConcurrent(int enable);
+
+/**
+ * Counts the free blocks in the map using the vectorized popcount kernel.
+ *
+ * @return The number of blocks whose bit is clear.
+ */
+int countFreeBlocks();
+
 /**
  * Clears the specified number of blocks in the bitmap, starting from the given block index.
- * Writes the updated map to the LBA
+ * Writes the changed bitmap blocks to the LBA
  *
  * @param start The starting block index to clear.
  * @param length The number of blocks to clear.
@@ -0,0 +1,197 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: bitmapScan.c
+ *
+ * Description: vectorized bitmap scanning kernels with a scalar fallback.
+ * The AVX2 kernels compare 8 words (256 blocks) per step, the SSE2 kernels
+ * 4 words (128 blocks). The selection is made once through CPU feature
+ * detection and stored in function pointers.
+ *
+ **************************************************************/
+#include "bitmapScan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#else
+#define SCAN_X86 0
+#endif
+
+typedef int (*scanFn)(const uint32_t* map, int from, int to);
+typedef int (*countFn)(const uint32_t* map, int numWords);
+
+/* FORWARD DECLARATION BLOCK */
+
+static int scanNonFullScalar(const uint32_t* map, int from, int to);
+static int scanNonEmptyScalar(const uint32_t* map, int from, int to);
+static int countScalar(const uint32_t* map, int numWords);
+static void useScalarKernels();
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static scanFn nonFullKernel = NULL;
+static scanFn nonEmptyKernel = NULL;
+static countFn countKernel = NULL;
+static const char* kernelName = "scalar";
+
+/* --- portable kernels --- */
+
+static int scanNonFullScalar(const uint32_t* map, int from, int to) {
+    int w = from;
+    while (w < to && __atomic_load_n(&map[w], __ATOMIC_RELAXED) == 0xFFFFFFFFu)
+        w++;
+    return w;
+}
+
+static int scanNonEmptyScalar(const uint32_t* map, int from, int to) {
+    int w = from;
+    while (w < to && __atomic_load_n(&map[w], __ATOMIC_RELAXED) == 0)
+        w++;
+    return w;
+}
+
+static int countScalar(const uint32_t* map, int numWords) {
+    int count = 0;
+    for (int w = 0; w < numWords; w++)
+        count += __builtin_popcount(__atomic_load_n(&map[w], __ATOMIC_RELAXED));
+    return count;
+}
+
+#if SCAN_X86
+
+/* --- SSE2 kernels, 4 words per step --- */
+
+__attribute__((target("sse2")))
+static int scanNonFullSSE2(const uint32_t* map, int from, int to) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    int w = from;
+    for (; w + 4 <= to; w += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(map + w));
+        // 0xFFFF means all four words compared equal to all ones
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, ones)) != 0xFFFF)
+            break;
+    }
+    return scanNonFullScalar(map, w, to);
+}
+
+__attribute__((target("sse2")))
+static int scanNonEmptySSE2(const uint32_t* map, int from, int to) {
+    const __m128i zero = _mm_setzero_si128();
+    int w = from;
+    for (; w + 4 <= to; w += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(map + w));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, zero)) != 0xFFFF)
+            break;
+    }
+    return scanNonEmptyScalar(map, w, to);
+}
+
+/* --- AVX2 kernels, 8 words (256 bits) per step --- */
+
+__attribute__((target("avx2")))
+static int scanNonFullAVX2(const uint32_t* map, int from, int to) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    int w = from;
+    for (; w + 8 <= to; w += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(map + w));
+        // testc sets CF when v has every bit of ones set, i.e. 256 used blocks
+        if (!_mm256_testc_si256(v, ones))
+            break;
+    }
+    return scanNonFullScalar(map, w, to);
+}
+
+__attribute__((target("avx2")))
+static int scanNonEmptyAVX2(const uint32_t* map, int from, int to) {
+    int w = from;
+    for (; w + 8 <= to; w += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(map + w));
+        // testz sets ZF when v is all zero, i.e. 256 free blocks
+        if (!_mm256_testz_si256(v, v))
+            break;
+    }
+    return scanNonEmptyScalar(map, w, to);
+}
+
+__attribute__((target("avx2")))
+static int countAVX2(const uint32_t* map, int numWords) {
+    // nibble lookup popcount: count each 4-bit half with a shuffle,
+    // then sum the bytes of every 64-bit lane with sad
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+    __m256i total = _mm256_setzero_si256();
+
+    int w = 0;
+    for (; w + 8 <= numWords; w += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(map + w));
+        __m256i lo = _mm256_and_si256(v, lowMask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), lowMask);
+        __m256i bytes = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, total);
+    return (int)(lanes[0] + lanes[1] + lanes[2] + lanes[3]) + countScalar(map + w, numWords - w);
+}
+
+#endif
+
+static void useScalarKernels() {
+    nonFullKernel = scanNonFullScalar;
+    nonEmptyKernel = scanNonEmptyScalar;
+    countKernel = countScalar;
+    kernelName = "scalar";
+}
+
+const char* initBitmapScan() {
+    useScalarKernels();
+
+#if SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        nonFullKernel = scanNonFullAVX2;
+        nonEmptyKernel = scanNonEmptyAVX2;
+        countKernel = countAVX2;
+        kernelName = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        nonFullKernel = scanNonFullSSE2;
+        nonEmptyKernel = scanNonEmptySSE2;
+        kernelName = "sse2";
+    }
+#endif
+
+    return kernelName;
+}
+
+const char* setScanScalar(int scalar) {
+    if (scalar)
+        useScalarKernels();
+    else
+        initBitmapScan();
+    return kernelName;
+}
+
+int scanNonFullWord(const uint32_t* map, int from, int to) {
+    if (nonFullKernel == NULL)
+        initBitmapScan();
+    return nonFullKernel(map, from, to);
+}
+
+int scanNonEmptyWord(const uint32_t* map, int from, int to) {
+    if (nonEmptyKernel == NULL)
+        initBitmapScan();
+    return nonEmptyKernel(map, from, to);
+}
+
+int countSetBits(const uint32_t* map, int numWords) {
+    if (countKernel == NULL)
+        initBitmapScan();
+    return countKernel(map, numWords);
+}
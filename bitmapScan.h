@@ -0,0 +1,63 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: bitmapScan.h
+ *
+ * Description: Header file for the bitmap scanning kernels, includes exposed
+ * functions: initBitmapScan(), setScanScalar(), scanNonFullWord(), scanNonEmptyWord(),
+ * countSetBits()
+ *
+ * The kernels work on whole uint32_t words of bitmap->map. On x86 an AVX2
+ * (256 bits per step) or SSE2 (128 bits per step) version is picked at runtime,
+ * every other machine uses the portable scalar version.
+ *
+ **************************************************************/
+#ifndef _BITMAP_SCAN_H
+#define _BITMAP_SCAN_H
+
+#include <stdint.h>
+
+/**
+ * Picks the fastest kernel the CPU supports. Called automatically on first use,
+ * calling it again is harmless.
+ *
+ * @return Name of the selected kernel ("avx2", "sse2" or "scalar").
+ */
+const char* initBitmapScan();
+
+/**
+ * Switches to the scalar kernels, or back to the fastest one. The scalar kernels
+ * read each word with a relaxed atomic load, so they may scan a map other threads
+ * are changing; bitmap.c uses them while in concurrent allocation mode.
+ * Must not be called while a scan is running.
+ *
+ * @param scalar 1 for the scalar kernels, 0 for the fastest the CPU supports
+ * @return Name of the selected kernel.
+ */
+const char* setScanScalar(int scalar);
+
+/**
+ * Finds the first word in [from, to) that has at least one free (0) bit,
+ * skipping fully allocated regions of the map.
+ *
+ * @return The word index, or to if every word in the range is full.
+ */
+int scanNonFullWord(const uint32_t* map, int from, int to);
+
+/**
+ * Finds the first word in [from, to) that has at least one used (1) bit,
+ * skipping fully free regions of the map.
+ *
+ * @return The word index, or to if every word in the range is empty.
+ */
+int scanNonEmptyWord(const uint32_t* map, int from, int to);
+
+/**
+ * Counts the set bits in the first numWords words of the map.
+ */
+int countSetBits(const uint32_t* map, int numWords);
+
+#endif
@@ -0,0 +1,262 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: bitmapTest.c
+ *
+ * Description: tests of the bitmap, each on a scratch volume. Run them with "make test".
+ *
+ * The concurrent allocation mode (setMapConcurrent): several threads allocate,
+ * grow and free runs of blocks at once. Every block a thread is handed is recorded
+ * with an atomic exchange in an owner table, so a block handed to two threads at
+ * the same time is caught when it happens, not only in the final map.
+ *
+ * The v1 map (initLegacyMap): a volume larger than the V1_MAP_BITS blocks its fixed
+ * map covers is filled up, and no block past them may be handed out nor the block
+ * after the map (where the v1 root directory lives) be written.
+ *
+ **************************************************************/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bitmap.h"
+#include "fsLow.h"
+
+#define TEST_VOLUME "BitmapTestVolume"
+#define TEST_BLOCKS 40000
+#define TEST_BLOCK_SIZE 512
+#define TEST_THREADS 8
+#define TEST_ROUNDS 4000
+#define TEST_MAX_RUN 16  // longest run asked for at once
+#define TEST_HELD 64     // runs a thread holds at most
+#define TEST_V1_BLOCKS 40000
+
+// One run of blocks a thread holds
+typedef struct {
+    int start;
+    int length;
+} heldRun;
+
+// Per thread state, the thread's id is 1 based so 0 means no owner
+typedef struct {
+    int id;
+    int allocations;
+} testThread;
+
+// Owning thread of every block, 0 for blocks no thread holds
+static int* owner = NULL;
+
+// Blocks found handed out twice
+static int failures = 0;
+
+/* FORWARD DECLARATION BLOCK */
+
+// Records that thread id was handed [start, start + length), reporting any block already held
+static void takeRun(int id, int start, int length);
+
+// Gives [start, start + length) back: drops the owner records, then frees the blocks
+static void giveRun(int start, int length);
+
+// Body of every test thread: random allocations, growths and frees
+static void* allocThread(void* arg);
+
+// Creates the scratch volume anew with totalBlocks blocks, returns 0 on success
+static int openTestVolume(int totalBlocks);
+
+// Closes the scratch volume and deletes its file
+static void closeTestVolume();
+
+// Runs the threads of the concurrent allocation test, returns 1 if it passed
+static int testConcurrent();
+
+// Fills a v1 map on a volume it does not fully cover, returns 1 if it passed
+static int testLegacyMap();
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static void takeRun(int id, int start, int length) {
+    for (int b = start; b < start + length; b++) {
+        int previous = __atomic_exchange_n(&owner[b], id, __ATOMIC_SEQ_CST);
+        if (previous != 0) {
+            fprintf(stderr, "ERROR: block %d handed to thread %d while thread %d holds it\n", b, id, previous);
+            __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void giveRun(int start, int length) {
+    for (int b = start; b < start + length; b++) {
+        __atomic_store_n(&owner[b], 0, __ATOMIC_SEQ_CST);
+    }
+    clearBlocks(start, length);
+}
+
+static void* allocThread(void* arg) {
+    testThread* self = arg;
+    unsigned int seed = self->id;
+    heldRun held[TEST_HELD];
+    int count = 0;
+
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        // free a third of the time, and whenever no more runs can be held
+        if (count == TEST_HELD || (count > 0 && rand_r(&seed) % 3 == 0)) {
+            int i = rand_r(&seed) % count;
+            giveRun(held[i].start, held[i].length);
+            held[i] = held[--count];
+            continue;
+        }
+
+        int length = 1 + rand_r(&seed) % TEST_MAX_RUN;
+
+        // grow a held run, in place when the blocks after it are free, else in a new extent
+        if (count > 0 && rand_r(&seed) % 4 == 0) {
+            heldRun* run = &held[rand_r(&seed) % count];
+            extent extents[3];
+            memset(extents, 0, sizeof(extents));
+            int ret = allocateAdditionalBlocks(run->start, run->length, length, extents);
+            if (ret == 0) {
+                takeRun(self->id, run->start + run->length, length);
+                run->length += length;
+                self->allocations++;
+            } else if (ret == 1) {
+                takeRun(self->id, extents[0].blockNumber, extents[0].count);
+                held[count].start = extents[0].blockNumber;
+                held[count].length = extents[0].count;
+                count++;
+                self->allocations++;
+            }
+            continue;
+        }
+
+        int start = allocateFirstBlocks(length);
+        if (start >= 0) {
+            takeRun(self->id, start, length);
+            held[count].start = start;
+            held[count].length = length;
+            count++;
+            self->allocations++;
+        }
+    }
+
+    while (count > 0) {
+        count--;
+        giveRun(held[count].start, held[count].length);
+    }
+    return NULL;
+}
+
+static int openTestVolume(int totalBlocks) {
+    uint64_t volumeSize = (uint64_t)totalBlocks * TEST_BLOCK_SIZE;
+    uint64_t blockSize = TEST_BLOCK_SIZE;
+
+    unlink(TEST_VOLUME);
+    if (startPartitionSystem(TEST_VOLUME, &volumeSize, &blockSize) != 0) {
+        fprintf(stderr, "ERROR: could not create %s\n", TEST_VOLUME);
+        return -1;
+    }
+    return 0;
+}
+
+static void closeTestVolume() {
+    closePartitionSystem();
+    unlink(TEST_VOLUME);
+}
+
+static int testConcurrent() {
+    if (openTestVolume(TEST_BLOCKS) != 0)
+        return 0;
+    owner = calloc(TEST_BLOCKS, sizeof(int));
+    if (owner == NULL || initMap(0, TEST_BLOCKS, TEST_BLOCK_SIZE) < 0) {
+        fprintf(stderr, "Memory Allocation Error");
+        closeTestVolume();
+        return 0;
+    }
+    int freeBefore = countFreeBlocks();
+
+    setMapConcurrent(1);
+    pthread_t threads[TEST_THREADS];
+    testThread state[TEST_THREADS];
+    for (int t = 0; t < TEST_THREADS; t++) {
+        state[t].id = t + 1;
+        state[t].allocations = 0;
+        pthread_create(&threads[t], NULL, allocThread, &state[t]);
+    }
+    int allocations = 0;
+    for (int t = 0; t < TEST_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+        allocations += state[t].allocations;
+    }
+    int freeConcurrent = countFreeBlocks();
+    setMapConcurrent(0);
+
+    // every run was given back, so the map and its summary level must be as they started
+    int freeAfter = countFreeBlocks();
+    int ok = (failures == 0 && freeConcurrent == freeBefore && freeAfter == freeBefore);
+    printf("bitmapTest: %d threads, %d allocations, %d blocks handed out twice, free %d/%d/%d: %s\n",
+           TEST_THREADS, allocations, failures, freeBefore, freeConcurrent, freeAfter, ok ? "passed" : "FAILED");
+
+    freeMap();
+    free(owner);
+    closeTestVolume();
+    return ok;
+}
+
+static int testLegacyMap() {
+    if (openTestVolume(TEST_V1_BLOCKS) != 0)
+        return 0;
+
+    // a v1 map as formatted: the VCB, the map itself and one root block in use
+    int rootLocation = MAP_LOCATION + V1_MAP_BLOCKS;
+    uint32_t* oldMap = calloc(V1_MAP_BLOCKS, TEST_BLOCK_SIZE);
+    char* root = malloc(TEST_BLOCK_SIZE);
+    char* check = malloc(TEST_BLOCK_SIZE);
+    if (oldMap == NULL || root == NULL || check == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        closeTestVolume();
+        return 0;
+    }
+    oldMap[0] = ((uint32_t)1 << (rootLocation + 1)) - 1;
+    memset(root, 0xA5, TEST_BLOCK_SIZE);
+    LBAwrite(oldMap, V1_MAP_BLOCKS, MAP_LOCATION);
+    LBAwrite(root, 1, rootLocation);
+
+    int ok = (initLegacyMap(TEST_V1_BLOCKS, TEST_BLOCK_SIZE) == MAP_LOCATION);
+    int freeBefore = countFreeBlocks();
+
+    // hand out everything, big runs first, then whatever single blocks are left
+    int handedOut = 0;
+    int highest = -1;
+    for (int length = 64; length > 0; length /= 2) {
+        int start;
+        while ((start = allocateFirstBlocks(length)) >= 0) {
+            handedOut += length;
+            if (start + length - 1 > highest)
+                highest = start + length - 1;
+        }
+    }
+    freeMap();
+
+    LBAread(check, 1, rootLocation);
+    ok = ok && freeBefore == V1_MAP_BITS - (rootLocation + 1) && handedOut == freeBefore &&
+         highest < V1_MAP_BITS && memcmp(root, check, TEST_BLOCK_SIZE) == 0;
+    printf("bitmapTest: v1 map on %d blocks, %d handed out, highest %d, root block %s: %s\n",
+           TEST_V1_BLOCKS, handedOut, highest, memcmp(root, check, TEST_BLOCK_SIZE) == 0 ? "intact" : "overwritten",
+           ok ? "passed" : "FAILED");
+
+    free(oldMap);
+    free(root);
+    free(check);
+    closeTestVolume();
+    return ok;
+}
+
+int main() {
+    int concurrentOk = testConcurrent();
+    int legacyOk = testLegacyMap();
+    return (concurrentOk && legacyOk) ? 0 : 1;
+}
@@ -0,0 +1,398 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: blockCache.c
+ *
+ * Description: fixed size LRU cache of volume blocks. Every metadata path
+ * (parsePath, the directory scans in b_io/mfs, the bitmap) goes through
+ * cachedLBAread/cachedLBAwrite so repeated reads of the same directory blocks
+ * are served from memory instead of the volume file.
+ *
+ * Entries live in one array and are linked two ways by index:
+ *   - a doubly linked LRU list (head = most recently used)
+ *   - a singly linked chain per hash bucket for lookup by LBA
+ *
+ * In write-back mode small writes only update the cached block and mark it
+ * dirty. Dirty blocks reach the volume when they are evicted, when the dirty
+ * byte limit is hit, or on flushBlockCache() (fs_sync / exitFileSystem).
+ *
+ **************************************************************/
+#include "blockCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsLow.h"
+
+typedef struct cacheEntry {
+    uint64_t lba;   // block held by this entry
+    int prev;       // LRU neighbour towards the head (more recent)
+    int next;       // LRU neighbour towards the tail (less recent), free list link when unused
+    int hashNext;   // next entry in the same hash bucket
+    int dirty;      // 1 if the cached copy is newer than the volume
+} cacheEntry;
+
+static cacheEntry* entries = NULL;
+static char* blockData = NULL;  // capacity * blockSize bytes, entry i owns slice i
+static int* buckets = NULL;
+static int numBuckets = 0;
+static int cacheCapacity = 0;
+static uint64_t cacheBlockSize = 0;
+
+static int lruHead = -1;
+static int lruTail = -1;
+static int freeHead = -1;  // chain of unused entries through .next
+
+static int writeBack = 0;        // 0 = write-through, 1 = write-back
+static uint64_t dirtyLimit = DEFAULT_DIRTY_LIMIT;
+
+static cacheStats stats;
+
+/* FORWARD DECLARATION BLOCK */
+
+// Returns the entry index holding lba, or -1 if it is not cached
+static int lookupBlock(uint64_t lba);
+
+// Copies a block into the cache, evicting the least recently used entry if full
+static int insertBlock(uint64_t lba, const char* data);
+
+// Moves an entry to the head of the LRU list
+static void touchEntry(int idx);
+
+// Writes a single dirty entry to the volume and marks it clean
+static int writeEntry(int idx);
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static inline char* entryData(int idx) {
+    return blockData + (uint64_t)idx * cacheBlockSize;
+}
+
+static inline int hashLBA(uint64_t lba) {
+    // multiplicative hash spreads neighbouring blocks across buckets
+    return (int)((lba * 0x9E3779B97F4A7C15ULL) >> 32) & (numBuckets - 1);
+}
+
+int initBlockCache(int capacity, uint64_t blockSize) {
+    if (capacity <= 0)
+        capacity = DEFAULT_CACHE_BLOCKS;
+
+    freeBlockCache();
+
+    // power of two bucket count, at least twice the capacity to keep chains short
+    numBuckets = 1;
+    while (numBuckets < capacity * 2)
+        numBuckets <<= 1;
+
+    entries = malloc(sizeof(cacheEntry) * capacity);
+    blockData = malloc((uint64_t)capacity * blockSize);
+    buckets = malloc(sizeof(int) * numBuckets);
+    if (entries == NULL || blockData == NULL || buckets == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        freeBlockCache();
+        return -1;
+    }
+
+    cacheCapacity = capacity;
+    cacheBlockSize = blockSize;
+
+    for (int i = 0; i < numBuckets; i++)
+        buckets[i] = -1;
+
+    // every entry starts on the free list
+    for (int i = 0; i < capacity; i++) {
+        entries[i].prev = -1;
+        entries[i].next = (i + 1 < capacity) ? i + 1 : -1;
+        entries[i].hashNext = -1;
+        entries[i].dirty = 0;
+    }
+    freeHead = 0;
+    lruHead = -1;
+    lruTail = -1;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.capacity = capacity;
+
+    return 0;
+}
+
+void freeBlockCache() {
+    if (entries != NULL)
+        flushBlockCache();
+
+    free(entries);
+    free(blockData);
+    free(buckets);
+    entries = NULL;
+    blockData = NULL;
+    buckets = NULL;
+    cacheCapacity = 0;
+    numBuckets = 0;
+    lruHead = lruTail = freeHead = -1;
+}
+
+static int lookupBlock(uint64_t lba) {
+    for (int idx = buckets[hashLBA(lba)]; idx != -1; idx = entries[idx].hashNext) {
+        if (entries[idx].lba == lba)
+            return idx;
+    }
+    return -1;
+}
+
+static void unlinkLRU(int idx) {
+    cacheEntry* e = &entries[idx];
+    if (e->prev != -1)
+        entries[e->prev].next = e->next;
+    else
+        lruHead = e->next;
+
+    if (e->next != -1)
+        entries[e->next].prev = e->prev;
+    else
+        lruTail = e->prev;
+
+    e->prev = e->next = -1;
+}
+
+static void pushFront(int idx) {
+    entries[idx].prev = -1;
+    entries[idx].next = lruHead;
+    if (lruHead != -1)
+        entries[lruHead].prev = idx;
+    lruHead = idx;
+    if (lruTail == -1)
+        lruTail = idx;
+}
+
+static void touchEntry(int idx) {
+    if (lruHead == idx)
+        return;
+    unlinkLRU(idx);
+    pushFront(idx);
+}
+
+static void removeFromHash(int idx) {
+    int* link = &buckets[hashLBA(entries[idx].lba)];
+    while (*link != -1) {
+        if (*link == idx) {
+            *link = entries[idx].hashNext;
+            break;
+        }
+        link = &entries[*link].hashNext;
+    }
+    entries[idx].hashNext = -1;
+}
+
+static int insertBlock(uint64_t lba, const char* data) {
+    int idx;
+
+    if (freeHead != -1) {
+        idx = freeHead;
+        freeHead = entries[idx].next;
+        stats.used++;
+    } else {
+        // reuse the least recently used entry, saving it first if it is dirty
+        idx = lruTail;
+        if (entries[idx].dirty)
+            writeEntry(idx);
+        unlinkLRU(idx);
+        removeFromHash(idx);
+        stats.evictions++;
+    }
+
+    entries[idx].lba = lba;
+    int bucket = hashLBA(lba);
+    entries[idx].hashNext = buckets[bucket];
+    buckets[bucket] = idx;
+    pushFront(idx);
+
+    memcpy(entryData(idx), data, cacheBlockSize);
+    return idx;
+}
+
+static void markDirty(int idx) {
+    if (!entries[idx].dirty) {
+        entries[idx].dirty = 1;
+        stats.dirty++;
+    }
+}
+
+static void markClean(int idx) {
+    if (entries[idx].dirty) {
+        entries[idx].dirty = 0;
+        stats.dirty--;
+    }
+}
+
+static int writeEntry(int idx) {
+    uint64_t written = LBAwrite(entryData(idx), 1, entries[idx].lba);
+    markClean(idx);
+    stats.writebacks++;
+    return written == 1 ? 0 : -1;
+}
+
+uint64_t cachedLBAread(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    if (entries == NULL)
+        return LBAread(buffer, lbaCount, lbaPosition);
+
+    char* out = buffer;
+
+    // bulk transfer: straight to the volume, then lay any dirty cached blocks
+    // over the result since they are newer than what is on disk
+    if (lbaCount > CACHE_BYPASS_BLOCKS) {
+        uint64_t got = LBAread(buffer, lbaCount, lbaPosition);
+        for (uint64_t i = 0; i < got && stats.dirty > 0; i++) {
+            int idx = lookupBlock(lbaPosition + i);
+            if (idx != -1 && entries[idx].dirty)
+                memcpy(out + i * cacheBlockSize, entryData(idx), cacheBlockSize);
+        }
+        return got;
+    }
+
+    uint64_t blocksRead = 0;
+    uint64_t i = 0;
+
+    while (i < lbaCount) {
+        int idx = lookupBlock(lbaPosition + i);
+        if (idx != -1) {
+            memcpy(out + i * cacheBlockSize, entryData(idx), cacheBlockSize);
+            touchEntry(idx);
+            stats.hits++;
+            blocksRead++;
+            i++;
+            continue;
+        }
+
+        // gather the run of missing blocks so it costs a single LBAread
+        uint64_t runEnd = i + 1;
+        while (runEnd < lbaCount && lookupBlock(lbaPosition + runEnd) == -1)
+            runEnd++;
+
+        uint64_t got = LBAread(out + i * cacheBlockSize, runEnd - i, lbaPosition + i);
+        stats.misses += runEnd - i;
+        for (uint64_t b = 0; b < got; b++)
+            insertBlock(lbaPosition + i + b, out + (i + b) * cacheBlockSize);
+
+        blocksRead += got;
+        if (got < runEnd - i)
+            break;  // short read from the volume, report what we have
+        i = runEnd;
+    }
+
+    return blocksRead;
+}
+
+uint64_t cachedLBAwrite(void* buffer, uint64_t lbaCount, uint64_t lbaPosition) {
+    if (entries == NULL)
+        return LBAwrite(buffer, lbaCount, lbaPosition);
+
+    const char* in = buffer;
+
+    // write-back: only the cached copy changes, the volume catches up on flush
+    if (writeBack && lbaCount <= CACHE_BYPASS_BLOCKS) {
+        for (uint64_t i = 0; i < lbaCount; i++) {
+            int idx = lookupBlock(lbaPosition + i);
+            if (idx != -1) {
+                memcpy(entryData(idx), in + i * cacheBlockSize, cacheBlockSize);
+                touchEntry(idx);
+            } else {
+                idx = insertBlock(lbaPosition + i, in + i * cacheBlockSize);
+            }
+            markDirty(idx);
+        }
+
+        if ((uint64_t)stats.dirty * cacheBlockSize >= dirtyLimit)
+            flushBlockCache();
+
+        return lbaCount;
+    }
+
+    uint64_t written = LBAwrite(buffer, lbaCount, lbaPosition);
+
+    // keep cached copies identical to the volume; small writes are also cached
+    // because directory and bitmap blocks are read back almost immediately
+    for (uint64_t i = 0; i < written; i++) {
+        int idx = lookupBlock(lbaPosition + i);
+        if (idx != -1) {
+            memcpy(entryData(idx), in + i * cacheBlockSize, cacheBlockSize);
+            markClean(idx);
+            touchEntry(idx);
+        } else if (lbaCount <= CACHE_BYPASS_BLOCKS) {
+            insertBlock(lbaPosition + i, in + i * cacheBlockSize);
+        }
+    }
+
+    return written;
+}
+
+void setCacheWriteBack(int enable, uint64_t limit) {
+    if (!enable && writeBack)
+        flushBlockCache();
+
+    writeBack = enable ? 1 : 0;
+    dirtyLimit = (limit > 0) ? limit : DEFAULT_DIRTY_LIMIT;
+}
+
+static int compareEntryLBA(const void* a, const void* b) {
+    uint64_t lbaA = entries[*(const int*)a].lba;
+    uint64_t lbaB = entries[*(const int*)b].lba;
+    return (lbaA > lbaB) - (lbaA < lbaB);
+}
+
+int flushBlockCache() {
+    if (entries == NULL || stats.dirty == 0)
+        return 0;
+
+    // collect the dirty entries and sort them so the volume is written front to back
+    int numDirty = 0;
+    int* dirtyList = malloc(sizeof(int) * stats.dirty);
+    if (dirtyList == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return -1;
+    }
+    for (int i = 0; i < cacheCapacity; i++) {
+        if (entries[i].dirty)
+            dirtyList[numDirty++] = i;
+    }
+    qsort(dirtyList, numDirty, sizeof(int), compareEntryLBA);
+
+    // stage each run of neighbouring LBAs so it goes out as one LBAwrite
+    int result = 0;
+    char* staging = malloc(CACHE_BYPASS_BLOCKS * cacheBlockSize);
+    int i = 0;
+    while (i < numDirty) {
+        int runEnd = i + 1;
+        while (staging != NULL && runEnd < numDirty && runEnd - i < CACHE_BYPASS_BLOCKS &&
+               entries[dirtyList[runEnd]].lba == entries[dirtyList[runEnd - 1]].lba + 1)
+            runEnd++;
+
+        if (runEnd - i == 1) {
+            if (writeEntry(dirtyList[i]) != 0)
+                result = -1;
+        } else {
+            for (int r = i; r < runEnd; r++)
+                memcpy(staging + (uint64_t)(r - i) * cacheBlockSize, entryData(dirtyList[r]), cacheBlockSize);
+
+            uint64_t written = LBAwrite(staging, runEnd - i, entries[dirtyList[i]].lba);
+            if (written != (uint64_t)(runEnd - i))
+                result = -1;
+
+            for (int r = i; r < runEnd; r++)
+                markClean(dirtyList[r]);
+            stats.writebacks += runEnd - i;
+        }
+        i = runEnd;
+    }
+
+    free(staging);
+    free(dirtyList);
+    return result;
+}
+
+void getCacheStats(cacheStats* stats_out) {
+    memcpy(stats_out, &stats, sizeof(cacheStats));
+}
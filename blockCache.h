@@ -0,0 +1,98 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: blockCache.h
+ *
+ * Description: Header file for the LRU block cache that sits in front of
+ * LBAread/LBAwrite, includes exposed functions: initBlockCache(), freeBlockCache(),
+ * cachedLBAread(), cachedLBAwrite(), setCacheWriteBack(), flushBlockCache(),
+ * getCacheStats()
+ *
+ *
+ **************************************************************/
+#ifndef _BLOCK_CACHE_H
+#define _BLOCK_CACHE_H
+
+#include <stdint.h>
+
+// Number of blocks held by the cache when the caller has no preference
+#define DEFAULT_CACHE_BLOCKS 256
+
+// Requests spanning more blocks than this go straight to the LBA layer so that
+// bulk file data does not evict the directory and bitmap blocks we want to keep hot
+#define CACHE_BYPASS_BLOCKS 16
+
+// In write-back mode the cache is flushed once this many bytes are dirty
+#define DEFAULT_DIRTY_LIMIT (64 * 1024)
+
+typedef struct cacheStats {
+    uint64_t hits;       // blocks served from memory
+    uint64_t misses;     // blocks that had to be read from the volume
+    uint64_t evictions;  // blocks pushed out to make room
+    uint64_t writebacks; // dirty blocks written to the volume by a flush or eviction
+    int dirty;           // number of cached blocks not yet on the volume
+    int capacity;        // number of blocks the cache can hold
+    int used;            // number of blocks currently cached
+} cacheStats;
+
+/**
+ * Allocates the cache and its lookup table. Must be called before the first
+ * cachedLBAread/cachedLBAwrite; until then both fall through to the LBA layer.
+ *
+ * @param capacity  Number of blocks to keep in memory (DEFAULT_CACHE_BLOCKS if <= 0)
+ * @param blockSize Size of a single block in bytes
+ *
+ * @return 0 on success, -1 on memory allocation error.
+ */
+int initBlockCache(int capacity, uint64_t blockSize);
+
+/**
+ * Writes back any dirty blocks, then frees every cached block and the lookup table.
+ */
+void freeBlockCache();
+
+/**
+ * Drop-in replacement for LBAread that serves blocks from memory when possible.
+ * Missing blocks are read from the volume in contiguous runs and then cached.
+ *
+ * @return The number of blocks read (lbaCount on success).
+ */
+uint64_t cachedLBAread(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+
+/**
+ * Drop-in replacement for LBAwrite. In write-through mode (the default) writes go
+ * to the volume and any cached copies are refreshed. In write-back mode small
+ * writes only mark the cached block dirty; repeated writes to the same LBA are
+ * merged and reach the volume on the next flush.
+ *
+ * @return The number of blocks written (lbaCount on success).
+ */
+uint64_t cachedLBAwrite(void* buffer, uint64_t lbaCount, uint64_t lbaPosition);
+
+/**
+ * Switches between write-through and write-back mode. Turning write-back off
+ * flushes all dirty blocks first.
+ *
+ * @param enable     1 for write-back, 0 for write-through
+ * @param dirtyLimit Bytes allowed to be dirty before an automatic flush
+ *                   (DEFAULT_DIRTY_LIMIT if 0)
+ */
+void setCacheWriteBack(int enable, uint64_t dirtyLimit);
+
+/**
+ * Writes every dirty block to the volume in ascending LBA order, merging
+ * neighbouring blocks into a single LBAwrite.
+ *
+ * @return 0 on success, -1 if a write came up short.
+ */
+int flushBlockCache();
+
+/**
+ * Copies the current hit/miss counters into stats.
+ */
+void getCacheStats(cacheStats* stats);
+
+#endif
@@ -0,0 +1,297 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: dentryCache.c
+ *
+ * Description: direct mapped cache of (directory location, name) to
+ * directoryEntry, filled by parsePath() and emptied entry by entry by the
+ * operations that change a directory, plus the per-directory name filters
+ * that answer lookups of names a directory does not have.
+ *
+ **************************************************************/
+#include "dentryCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsLow.h"
+
+typedef struct dentrySlot {
+    int64_t dirLocation;    // first block of the directory holding the entry, 0 for an empty slot
+    int negative;           // 1 if the directory has no entry by this name
+    directoryEntry entry;   // name is the key's second half, the rest is unused for a negative slot
+} dentrySlot;
+
+typedef struct nameFilter {
+    int64_t dirLocation;    // directory the filter describes, 0 for an unused filter
+    uint64_t lastUse;       // lookup clock value of the last use, the oldest filter is replaced first
+    int64_t numBits;        // a power of two
+    int64_t names;          // names added so far
+    int64_t capacity;       // names the filter was sized for
+    unsigned char* bits;
+} nameFilter;
+
+typedef struct freeHint {
+    int64_t dirLocation;    // 0 for an unused hint
+    int64_t dirBlock;       // first block of the directory that may have a free entry
+} freeHint;
+
+static dentrySlot slots[DENTRY_CACHE_SLOTS];
+static freeHint hints[DENTRY_FREE_HINTS];
+static nameFilter filters[DENTRY_FILTERS];
+static nameFilter pending;      // filter being filled by a scan, installed if the scan misses
+static uint64_t filterClock = 0;
+
+/* FORWARD DECLARATION BLOCK */
+
+// 64 bit FNV-1a hash of a name, mixed with a directory location
+static uint64_t hashKey(int64_t dirLocation, const char* name);
+
+// Slot a (directory, name) key maps to
+static int slotFor(int64_t dirLocation, const char* name);
+
+// Free entry hint slot a directory maps to
+static freeHint* hintFor(int64_t dirLocation);
+
+// The filter of a directory, or NULL if it has none
+static nameFilter* findFilter(int64_t dirLocation);
+
+// Sets or tests the FILTER_HASHES bits of a name, test returns 1 only if all are set
+static void filterAdd(nameFilter* filter, const char* name);
+static int filterTest(nameFilter* filter, const char* name);
+
+// Frees a filter's bits and marks it unused
+static void dropFilter(nameFilter* filter);
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static uint64_t hashKey(int64_t dirLocation, const char* name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char* c = (const unsigned char*)name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 1099511628211ULL;
+    }
+
+    // the location is mixed in after the name: seeding with it left the low (slot) bits of
+    // short names in nearby directories depending only on location ^ name, so they collided
+    hash ^= (uint64_t)dirLocation * 0x9E3779B97F4A7C15ULL;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static int slotFor(int64_t dirLocation, const char* name) {
+    return (int)(hashKey(dirLocation, name) & (DENTRY_CACHE_SLOTS - 1));
+}
+
+static freeHint* hintFor(int64_t dirLocation) {
+    return &hints[hashKey(dirLocation, "") & (DENTRY_FREE_HINTS - 1)];
+}
+
+int dentryCacheLookup(int64_t dirLocation, const char* name, directoryEntry* out) {
+    dentrySlot* slot = &slots[slotFor(dirLocation, name)];
+    if (slot->dirLocation != dirLocation || dirLocation == 0 || strcmp(slot->entry.name, name) != 0)
+        return 0;
+    if (slot->negative)
+        return -1;
+
+    memcpy(out, &slot->entry, sizeof(directoryEntry));
+    return 1;
+}
+
+void dentryCacheInsert(int64_t dirLocation, const char* name, const directoryEntry* entry) {
+    // names too long for an entry can never match one
+    if (dirLocation <= 0 || strlen(name) >= sizeof(entry->name))
+        return;
+
+    dentrySlot* slot = &slots[slotFor(dirLocation, name)];
+    slot->dirLocation = dirLocation;
+    slot->negative = 0;
+    memcpy(&slot->entry, entry, sizeof(directoryEntry));
+}
+
+void dentryCacheInsertNegative(int64_t dirLocation, const char* name) {
+    // names too long to ever exist are answered by the length check in the lookup
+    if (dirLocation <= 0 || strlen(name) >= sizeof(slots[0].entry.name))
+        return;
+
+    dentrySlot* slot = &slots[slotFor(dirLocation, name)];
+    slot->dirLocation = dirLocation;
+    slot->negative = 1;
+    memset(&slot->entry, 0, sizeof(directoryEntry));
+    strcpy(slot->entry.name, name);
+}
+
+int dentryCacheMayContain(int64_t dirLocation, const char* name) {
+    nameFilter* filter = findFilter(dirLocation);
+    if (filter == NULL)
+        return -1;
+
+    filter->lastUse = ++filterClock;
+    return filterTest(filter, name);
+}
+
+void dentryCacheCreated(int64_t dirLocation, const char* name) {
+    dentryCacheInvalidate(dirLocation, name);
+
+    nameFilter* filter = findFilter(dirLocation);
+    if (filter == NULL)
+        return;
+
+    // past its planned size the filter answers "maybe" too often to be worth keeping
+    if (filter->names >= filter->capacity)
+        dropFilter(filter);
+    else
+        filterAdd(filter, name);
+}
+
+void dentryCacheRemoved(int64_t dirLocation, const char* name) {
+    dentryCacheInvalidate(dirLocation, name);
+
+    freeHint* hint = hintFor(dirLocation);
+    if (hint->dirLocation == dirLocation)
+        hint->dirLocation = 0;
+}
+
+void dentryCacheInvalidate(int64_t dirLocation, const char* name) {
+    dentrySlot* slot = &slots[slotFor(dirLocation, name)];
+    if (slot->dirLocation == dirLocation && strcmp(slot->entry.name, name) == 0)
+        slot->dirLocation = 0;
+}
+
+void dentryCacheInvalidateDir(int64_t dirLocation) {
+    for (int i = 0; i < DENTRY_CACHE_SLOTS; i++) {
+        if (slots[i].dirLocation == dirLocation)
+            slots[i].dirLocation = 0;
+    }
+
+    nameFilter* filter = findFilter(dirLocation);
+    if (filter != NULL)
+        dropFilter(filter);
+
+    freeHint* hint = hintFor(dirLocation);
+    if (hint->dirLocation == dirLocation)
+        hint->dirLocation = 0;
+}
+
+void dentryCacheInvalidateInode(int64_t inode) {
+    for (int i = 0; i < DENTRY_CACHE_SLOTS; i++) {
+        if (slots[i].dirLocation != 0 && !slots[i].negative && slots[i].entry.inode == inode)
+            slots[i].dirLocation = 0;
+    }
+}
+
+int64_t dentryCacheFreeHint(int64_t dirLocation) {
+    freeHint* hint = hintFor(dirLocation);
+    return (hint->dirLocation == dirLocation && dirLocation > 0) ? hint->dirBlock : 0;
+}
+
+void dentryCacheSetFreeHint(int64_t dirLocation, int64_t dirBlock) {
+    if (dirLocation <= 0)
+        return;
+
+    freeHint* hint = hintFor(dirLocation);
+    hint->dirLocation = dirLocation;
+    hint->dirBlock = dirBlock;
+}
+
+void dentryCacheClear() {
+    memset(slots, 0, sizeof(slots));
+    memset(hints, 0, sizeof(hints));
+    for (int i = 0; i < DENTRY_FILTERS; i++)
+        dropFilter(&filters[i]);
+    dropFilter(&pending);
+    filterClock = 0;
+}
+
+static nameFilter* findFilter(int64_t dirLocation) {
+    if (dirLocation <= 0)
+        return NULL;
+
+    for (int i = 0; i < DENTRY_FILTERS; i++) {
+        if (filters[i].dirLocation == dirLocation)
+            return &filters[i];
+    }
+    return NULL;
+}
+
+static void filterAdd(nameFilter* filter, const char* name) {
+    // double hashing: the two halves of one hash give all FILTER_HASHES bit positions
+    uint64_t hash = hashKey(0, name);
+    uint64_t step = (hash >> 32) | 1;
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        uint64_t bit = (hash + i * step) & (filter->numBits - 1);
+        filter->bits[bit / 8] |= (unsigned char)(1 << (bit % 8));
+    }
+    filter->names++;
+}
+
+static int filterTest(nameFilter* filter, const char* name) {
+    uint64_t hash = hashKey(0, name);
+    uint64_t step = (hash >> 32) | 1;
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        uint64_t bit = (hash + i * step) & (filter->numBits - 1);
+        if (!(filter->bits[bit / 8] & (1 << (bit % 8))))
+            return 0;
+    }
+    return 1;
+}
+
+static void dropFilter(nameFilter* filter) {
+    free(filter->bits);
+    memset(filter, 0, sizeof(nameFilter));
+}
+
+int dentryCacheFilterStart(int64_t dirLocation, int64_t blocks) {
+    dropFilter(&pending);
+    if (dirLocation <= 0 || findFilter(dirLocation) != NULL)
+        return 0;
+
+    // sized for twice the directory's current entries, so it survives a good many creates
+    int64_t capacity = 2 * blocks * ENTRIES_PER_BLOCK;
+    int64_t numBits = 64;
+    while (numBits < capacity * FILTER_BITS_PER_NAME)
+        numBits *= 2;
+
+    unsigned char* bits = calloc(numBits / 8, 1);
+    if (bits == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return 0;
+    }
+
+    pending.dirLocation = dirLocation;
+    pending.numBits = numBits;
+    pending.capacity = capacity;
+    pending.bits = bits;
+    return 1;
+}
+
+void dentryCacheFilterName(const char* name) {
+    if (pending.bits != NULL)
+        filterAdd(&pending, name);
+}
+
+void dentryCacheFilterFinish(int complete) {
+    if (!complete || pending.bits == NULL) {
+        dropFilter(&pending);
+        return;
+    }
+
+    // reuse an unused filter, or the one gone longest without a lookup
+    nameFilter* filter = &filters[0];
+    for (int i = 0; i < DENTRY_FILTERS; i++) {
+        if (filters[i].dirLocation == 0) {
+            filter = &filters[i];
+            break;
+        }
+        if (filters[i].lastUse < filter->lastUse)
+            filter = &filters[i];
+    }
+    dropFilter(filter);
+    memcpy(filter, &pending, sizeof(nameFilter));
+    filter->lastUse = ++filterClock;
+    memset(&pending, 0, sizeof(nameFilter));
+}
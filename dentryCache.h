@@ -0,0 +1,151 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: dentryCache.h
+ *
+ * Description: Header file for the in-memory cache of directory entries found
+ * by parsePath(), includes exposed functions: dentryCacheLookup(),
+ * dentryCacheInsert(), dentryCacheInsertNegative(), dentryCacheMayContain(),
+ * dentryCacheCreated(), dentryCacheRemoved(), dentryCacheInvalidate(),
+ * dentryCacheInvalidateDir(), dentryCacheInvalidateInode(), dentryCacheFilterStart(),
+ * dentryCacheFilterName(), dentryCacheFilterFinish(), dentryCacheFreeHint(),
+ * dentryCacheSetFreeHint(), dentryCacheClear()
+ *
+ * Entries are keyed by the location of the directory holding them and their
+ * name, so a path whose components are all cached resolves without any reads.
+ * The table is direct mapped: a new entry simply replaces whatever hashed to
+ * the same slot. A slot can also remember that a name is absent. Anything that
+ * rewrites, removes or renames an entry on disk has to invalidate its key, and
+ * anything that creates one has to report it through dentryCacheCreated();
+ * "." and ".." are never cached.
+ *
+ * Directories that have answered a lookup with "not found" by a scan also get a
+ * Bloom filter of their names, filled from the names that scan read, so later
+ * misses in them are answered without reading the directory at all. Directories
+ * with a hash index (see dirIndex.h) answer misses without a scan and get none.
+ * Names are only ever
+ * added to a filter; a removed name just costs a real lookup until the filter
+ * fills past the number of names it was sized for and is dropped.
+ *
+ * Directories being filled also remember the first block that may still have a
+ * free entry, so creating many files in a large directory does not rescan the
+ * blocks already full. Removing an entry forgets the hint.
+ *
+ **************************************************************/
+#ifndef _DENTRY_CACHE_H
+#define _DENTRY_CACHE_H
+
+#include "directoryEntry.h"
+
+// Number of entries the cache holds, a power of two
+#define DENTRY_CACHE_SLOTS 1024
+
+// Number of directories with a name filter at a time
+#define DENTRY_FILTERS 32
+
+// Number of directories with a free entry hint at a time, a power of two
+#define DENTRY_FREE_HINTS 64
+
+// Filter bits per name it is sized for, and hashes per name (about 1% false positives)
+#define FILTER_BITS_PER_NAME 10
+#define FILTER_HASHES 4
+
+/**
+ * Looks up the entry called name in the directory starting at dirLocation.
+ *
+ * @return 1 and a copy of the entry in out on a hit, -1 if the name is known
+ *         to be absent, 0 if the cache cannot tell.
+ */
+int dentryCacheLookup(int64_t dirLocation, const char* name, directoryEntry* out);
+
+/**
+ * Remembers an entry just read from the directory starting at dirLocation.
+ */
+void dentryCacheInsert(int64_t dirLocation, const char* name, const directoryEntry* entry);
+
+/**
+ * Remembers that the directory starting at dirLocation has no entry called name.
+ */
+void dentryCacheInsertNegative(int64_t dirLocation, const char* name);
+
+/**
+ * Asks the directory's name filter about name.
+ *
+ * @return 0 if the directory certainly has no such entry, 1 if it may have one,
+ *         -1 if the directory has no filter.
+ */
+int dentryCacheMayContain(int64_t dirLocation, const char* name);
+
+/**
+ * Reports a new entry called name in the directory starting at dirLocation
+ * (create, mkdir, move into it). Clears a cached "absent" and adds the name to
+ * the directory's filter.
+ */
+void dentryCacheCreated(int64_t dirLocation, const char* name);
+
+/**
+ * Reports that the entry called name in the directory starting at dirLocation
+ * was removed (delete, rmdir, move out of it). Forgets the entry and the
+ * directory's free entry hint, since the freed entry may lie before it.
+ */
+void dentryCacheRemoved(int64_t dirLocation, const char* name);
+
+/**
+ * Forgets the entry called name in the directory starting at dirLocation.
+ */
+void dentryCacheInvalidate(int64_t dirLocation, const char* name);
+
+/**
+ * Forgets every entry, the name filter and the free entry hint of the directory starting at
+ * dirLocation, for a directory being removed whose blocks may soon hold another one.
+ */
+void dentryCacheInvalidateDir(int64_t dirLocation);
+
+/**
+ * Forgets every name of an inode (see inode.h), for a hard linked file written through
+ * one of them.
+ */
+void dentryCacheInvalidateInode(int64_t inode);
+
+/**
+ * Starts a name filter for a directory about to be scanned from its first block to
+ * its last, unless it has one already.
+ *
+ * @param blocks Number of blocks in the directory.
+ * @return 1 if the scan should pass every name to dentryCacheFilterName(), 0 if not.
+ */
+int dentryCacheFilterStart(int64_t dirLocation, int64_t blocks);
+
+/**
+ * Adds a name read by the scan to the filter being started.
+ */
+void dentryCacheFilterName(const char* name);
+
+/**
+ * Ends a scan begun with dentryCacheFilterStart().
+ *
+ * @param complete 1 if the scan read every name of the directory (it missed), so the
+ *                 filter is kept, 0 if it stopped early and the filter is dropped.
+ */
+void dentryCacheFilterFinish(int complete);
+
+/**
+ * @return Index within the directory starting at dirLocation of the first block
+ *         that may have a free entry; every block before it is full. 0 if unknown.
+ */
+int64_t dentryCacheFreeHint(int64_t dirLocation);
+
+/**
+ * Records that every block of the directory before dirBlock is full.
+ */
+void dentryCacheSetFreeHint(int64_t dirLocation, int64_t dirBlock);
+
+/**
+ * Empties the cache and drops every filter and hint (mount and unmount).
+ */
+void dentryCacheClear();
+
+#endif
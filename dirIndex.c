@@ -0,0 +1,253 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: dirIndex.c
+ *
+ * Description: per-directory hash index of entry names. The slot table is
+ * read and written a block at a time through the block cache; probing usually
+ * stays within the bucket block the name hashes to.
+ *
+ **************************************************************/
+#include "dirIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockCache.h"
+#include "fsLow.h"
+
+typedef struct indexSlot {
+    uint32_t hash;      // hash of the entry's name
+    uint32_t unused;
+    int64_t position;   // block * ENTRIES_PER_BLOCK + index in block + 1, 0 for an empty slot
+} indexSlot;
+
+#define SLOTS_PER_BLOCK (vcbPointer->blockSize / (int)sizeof(indexSlot))
+
+/* FORWARD DECLARATION BLOCK */
+
+// FNV-1a hash of a name
+static uint32_t hashName(const char* name);
+
+// Puts a position into the first free slot from the name's home slot of an in-memory table
+static void insertSlot(indexSlot* slots, int64_t numSlots, uint32_t hash, int64_t position);
+
+/**
+ * Builds a new index of blocks blocks from every live entry of the directory whose
+ * "." entry is self, frees the old one if there is one and points self at the new one.
+ * The caller writes self back.
+ */
+static int rebuildIndex(directoryEntry* self, int blocks);
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static uint32_t hashName(const char* name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char* c = (const unsigned char*)name; *c != '\0'; c++) {
+        hash ^= *c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void insertSlot(indexSlot* slots, int64_t numSlots, uint32_t hash, int64_t position) {
+    int64_t pos = hash % numSlots;
+    while (slots[pos].position != 0)
+        pos = (pos + 1) % numSlots;
+    slots[pos].hash = hash;
+    slots[pos].position = position;
+}
+
+int dirIndexBuild(directoryEntry* self) {
+    if (!(vcbPointer->features & VCB_FEATURE_DIR_INDEX) || self->indexLocation > 0)
+        return 0;
+
+    // room for twice the entries the grown directory holds keeps probes short
+    int64_t entries = dirBlockCount(self) * ENTRIES_PER_BLOCK;
+    int blocks = (2 * entries + SLOTS_PER_BLOCK - 1) / SLOTS_PER_BLOCK;
+    return rebuildIndex(self, blocks);
+}
+
+int dirIndexLookup(int64_t dirLocation, const char* name, directoryEntry* out, int64_t* blockOut, int* indexOut) {
+    if (!(vcbPointer->features & VCB_FEATURE_DIR_INDEX) || dirLocation <= 0)
+        return -1;
+
+    // the "." entry says where the index is
+    directoryEntry self;
+    dirRecord* records = malloc(ENTRIES_PER_BLOCK * sizeof(dirRecord));
+    indexSlot* slotBlock = malloc(vcbPointer->blockSize);
+    if (records == NULL || slotBlock == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        free(records);
+        free(slotBlock);
+        return -1;
+    }
+
+    int64_t indexLocation = 0;
+    int64_t numSlots = 0;
+    if (readDirEntry(dirLocation, 0, &self) == 0) {
+        indexLocation = self.indexLocation;
+        numSlots = (int64_t)self.indexBlocks * SLOTS_PER_BLOCK;
+    }
+    if (indexLocation <= 0 || numSlots <= 0) {
+        free(records);
+        free(slotBlock);
+        return -1;
+    }
+
+    uint32_t hash = hashName(name);
+    int64_t pos = hash % numSlots;
+    int64_t loadedBlock = -1;
+    int found = 0;
+
+    // probe until an empty slot; slots of other names with the same hash fail the name check
+    for (int64_t probes = 0; probes < numSlots && !found; probes++, pos = (pos + 1) % numSlots) {
+        int64_t slotBlockNum = pos / SLOTS_PER_BLOCK;
+        if (slotBlockNum != loadedBlock) {
+            cachedLBAread(slotBlock, 1, indexLocation + slotBlockNum);
+            loadedBlock = slotBlockNum;
+        }
+
+        indexSlot* slot = &slotBlock[pos % SLOTS_PER_BLOCK];
+        if (slot->position == 0)
+            break;
+        if (slot->hash != hash)
+            continue;
+
+        // names first, so with an inode table only the match's inode is read
+        int64_t entryBlock = (slot->position - 1) / ENTRIES_PER_BLOCK;
+        int entryIndex = (slot->position - 1) % ENTRIES_PER_BLOCK;
+        readDirRecords(records, 1, entryBlock);
+
+        dirRecord* record = &records[entryIndex];
+        if (record->inode != 0 && strcmp(record->name, name) == 0) {
+            if (out != NULL && readDirEntry(entryBlock, entryIndex, out) < 0)
+                break;
+            if (blockOut != NULL)
+                *blockOut = entryBlock;
+            if (indexOut != NULL)
+                *indexOut = entryIndex;
+            found = 1;
+        }
+    }
+
+    free(records);
+    free(slotBlock);
+    return found;
+}
+
+int dirIndexAdd(int64_t dirLocation, const char* name, int64_t block, int indexInBlock) {
+    if (!(vcbPointer->features & VCB_FEATURE_DIR_INDEX) || dirLocation <= 0)
+        return 0;
+
+    directoryEntry selfEntry;
+    if (readDirEntry(dirLocation, 0, &selfEntry) < 0)
+        return -1;
+
+    directoryEntry* self = &selfEntry;
+    if (self->indexLocation <= 0)
+        return 0;
+
+    int64_t numSlots = (int64_t)self->indexBlocks * SLOTS_PER_BLOCK;
+
+    if ((int64_t)(self->indexUsed + 1) * 2 > numSlots) {
+        // half full (stale slots included): rebuild from the directory, which already holds
+        // the new entry; without room for a bigger table the directory goes back to being scanned
+        if (rebuildIndex(self, self->indexBlocks * 2) < 0)
+            dirIndexRelease(self);
+    }
+    else {
+        uint32_t hash = hashName(name);
+        int64_t pos = hash % numSlots;
+        indexSlot* slotBlock = malloc(vcbPointer->blockSize);
+        if (slotBlock == NULL) {
+            fprintf(stderr, "Memory Allocation Error");
+            return -1;
+        }
+
+        int64_t loadedBlock = -1;
+        while (1) {
+            int64_t slotBlockNum = pos / SLOTS_PER_BLOCK;
+            if (slotBlockNum != loadedBlock) {
+                cachedLBAread(slotBlock, 1, self->indexLocation + slotBlockNum);
+                loadedBlock = slotBlockNum;
+            }
+
+            indexSlot* slot = &slotBlock[pos % SLOTS_PER_BLOCK];
+            if (slot->position == 0) {
+                slot->hash = hash;
+                slot->position = block * ENTRIES_PER_BLOCK + indexInBlock + 1;
+                cachedLBAwrite(slotBlock, 1, self->indexLocation + slotBlockNum);
+                break;
+            }
+            pos = (pos + 1) % numSlots;
+        }
+        free(slotBlock);
+        self->indexUsed++;
+    }
+
+    return writeDirEntry(dirLocation, 0, self);
+}
+
+static int rebuildIndex(directoryEntry* self, int blocks) {
+    int64_t numSlots = (int64_t)blocks * SLOTS_PER_BLOCK;
+    indexSlot* slots = calloc(blocks, vcbPointer->blockSize);
+    dirRecord* records = malloc(ENTRIES_PER_BLOCK * sizeof(dirRecord));
+    if (slots == NULL || records == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        free(slots);
+        free(records);
+        return -1;
+    }
+
+    dirCursor cursor;
+    if (dirCursorOpen(&cursor, self->location) < 0) {
+        free(slots);
+        free(records);
+        return -1;
+    }
+
+    // every block of the directory, whichever run it is in
+    int used = 0;
+    int64_t lba;
+    while ((lba = dirCursorNext(&cursor)) >= 0) {
+        readDirRecords(records, 1, lba);
+        for (int j = 0; j < ENTRIES_PER_BLOCK; j++) {
+            dirRecord* record = &records[j];
+            if (record->inode == 0 || record->name[0] == '\0' ||
+                strcmp(record->name, ".") == 0 || strcmp(record->name, "..") == 0)
+                continue;
+            insertSlot(slots, numSlots, hashName(record->name), lba * ENTRIES_PER_BLOCK + j + 1);
+            used++;
+        }
+    }
+    free(records);
+
+    int location = allocateBlocksNear(blocks, self->location);
+    if (location < 0) {
+        fprintf(stderr, "ERROR: Could not allocate blocks for a directory index.\n");
+        free(slots);
+        return -1;
+    }
+    cachedLBAwrite(slots, blocks, location);
+    free(slots);
+
+    if (self->indexLocation > 0)
+        clearBlocks(self->indexLocation, self->indexBlocks);
+    self->indexLocation = location;
+    self->indexBlocks = blocks;
+    self->indexUsed = used;
+    return 0;
+}
+
+void dirIndexRelease(directoryEntry* self) {
+    if (self->indexLocation > 0 && self->indexBlocks > 0)
+        clearBlocks(self->indexLocation, self->indexBlocks);
+    self->indexLocation = 0;
+    self->indexBlocks = 0;
+    self->indexUsed = 0;
+}
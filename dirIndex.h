@@ -0,0 +1,68 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: dirIndex.h
+ *
+ * Description: Header file for the per-directory hash index of entry names,
+ * includes exposed functions: dirIndexBuild(), dirIndexLookup(), dirIndexAdd(),
+ * dirIndexRelease()
+ *
+ * The index is an open addressing (linear probing) table of name hashes kept in
+ * its own run of blocks; the directory's "." entry records where it lives. Each
+ * slot points at the block and position of an entry, so a lookup reads the
+ * "." block, usually one bucket block and the block holding the entry, however
+ * large the directory is. Only creates add slots: a slot left behind by a
+ * deleted or moved entry fails the name check on lookup and is dropped when the
+ * table fills up past half and is rebuilt from the directory at twice the size.
+ * A directory only gets an index once it grows past its first run; until then it
+ * is scanned (a miss usually not even that, see the name filters of dentryCache.h),
+ * as are directories of v1 volumes and volumes formatted before VCB_FEATURE_DIR_INDEX.
+ *
+ **************************************************************/
+#ifndef _DIR_INDEX_H
+#define _DIR_INDEX_H
+
+#include "directoryEntry.h"
+
+/**
+ * Gives a directory that has just grown past its first run an index of every entry
+ * it holds, filling in the index fields of its "." entry.
+ * Does nothing on volumes without VCB_FEATURE_DIR_INDEX or if the directory has one.
+ *
+ * @param self The directory's "." entry, on disk with its new run; written back by the caller.
+ *
+ * @return 0 on success, -1 if the directory was left without an index.
+ */
+int dirIndexBuild(directoryEntry* self);
+
+/**
+ * Looks a name up through the index of the directory starting at dirLocation.
+ *
+ * @param out        If not NULL, receives the entry.
+ * @param blockOut   If not NULL, receives the block holding the entry.
+ * @param indexOut   If not NULL, receives the entry's position within that block.
+ *
+ * @return 1 if found, 0 if the directory has no such entry, -1 if it has no index (scan it instead).
+ */
+int dirIndexLookup(int64_t dirLocation, const char* name, directoryEntry* out, int64_t* blockOut, int* indexOut);
+
+/**
+ * Records a new entry, already written at block/indexInBlock, in the index of its directory.
+ * Every create has to call this once the entry is on disk, after the last write of the
+ * directory's first block. Rebuilds the index at twice the size when it is half full.
+ *
+ * @return 0 on success (or when the directory has no index), -1 on failure.
+ */
+int dirIndexAdd(int64_t dirLocation, const char* name, int64_t block, int indexInBlock);
+
+/**
+ * Frees the index blocks of a directory being removed.
+ *
+ * @param self The directory's "." entry.
+ */
+void dirIndexRelease(directoryEntry* self);
+
+#endif
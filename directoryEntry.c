@@ -13,13 +13,74 @@
  **************************************************************/
 #include "directoryEntry.h"
 
+#include <limits.h>
 #include <malloc.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "blockCache.h"
+#include "dentryCache.h"
+#include "dirIndex.h"
+#include "extentTree.h"
 #include "fsLow.h"
+#include "inode.h"
+
+// Extent as stored on a v1 volume
+typedef struct extentV1 {
+	short blockNumber;
+	short count;
+} extentV1;
+
+// Entry as stored on a v1 volume (64 bytes)
+typedef struct directoryEntryV1 {
+	time_t date;
+	uint32_t fileSize;
+	extentV1 extentLocations[MAX_EXTENTS];
+	short location;
+	bool isDirectory;
+	char name[37];
+} directoryEntryV1;
+
+_Static_assert(offsetof(directoryEntry, inode) == DE_SIZE_V2, "v2 directory entries must stay 128 bytes");
+_Static_assert(sizeof(directoryEntryV1) == DE_SIZE_V1, "v1 directory entries must stay 64 bytes");
+_Static_assert(sizeof(dirRecord) == 48, "directory records must stay 48 bytes");
+
+/* FORWARD DECLARATION BLOCK */
+
+// Widens a v1 entry into the in-memory layout
+static void entryFromV1(directoryEntry* entry, directoryEntryV1* old);
+
+// Narrows an entry into the v1 layout, -1 if a size or block number does not fit
+static int entryToV1(directoryEntryV1* old, directoryEntry* entry);
+
+// Whether a name is "." or "..", which do not count as links to an inode
+static int isDotName(const char* name);
+
+/**
+ * Joins a record with its inode into an entry; a free record gives a free entry.
+ * @return 0 on success, -1 if the inode could not be read (the entry is left free)
+ */
+static int entryFromRecord(directoryEntry* entry, dirRecord* record);
+
+/**
+ * Points a record at an entry, on a volume with an inode table: gives a new entry an
+ * inode, writes the entry's inode and moves a link from the inode the record named to it.
+ * @return 0 on success, -1 if the entry could not get an inode (the record is unchanged)
+ */
+static int storeRecord(dirRecord* record, directoryEntry* entry);
+
+/**
+ * writeDirBlocks(), for blocks of a directory being created or grown when fresh is set:
+ * whatever the blocks held before is not a record of any inode.
+ */
+static uint64_t writeEntries(directoryEntry* entries, uint64_t blocks, uint64_t location, int fresh);
+
+/* FORWARD DECLARATION BLOCK END*/
 
 // Function Implementations
-void createEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t size, time_t date, int mapLocation) {
+void createEntry(directoryEntry* entry, char* name, bool isDirectory, uint64_t size, time_t date, int64_t mapLocation) {
+	memset(entry, 0, sizeof(directoryEntry));
 	strcpy(entry->name, name);
 	entry->isDirectory = isDirectory;
 	entry->fileSize = size;
@@ -33,7 +94,8 @@ void createEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t s
 	}
 }
 
-void copyEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t size, time_t date, int mapLocation, extent* extents) {
+void copyEntry(directoryEntry* entry, char* name, bool isDirectory, uint64_t size, time_t date, int64_t mapLocation, extent* extents) {
+	memset(entry, 0, sizeof(directoryEntry));
 	strcpy(entry->name, name);
 	entry->isDirectory = isDirectory;
 	entry->fileSize = size;
@@ -45,131 +107,68 @@ void copyEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t siz
 
 
 int createDirectory(directoryEntry* parentDir, char* newDirecName) {
-	// Buffer for reading/writing a block of directory entries (DEs)
+	refreshDirectory(parentDir);
+
+	// Buffer for writing a block of directory entries (DEs)
 	directoryEntry * buffBlockDE = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
 
 	/// CHECK FOR EXISTING DE WITH name FROM newDirecName
-	///		- side objective: find first blankDE to fill
-	// Info for blank DE to fill - if found while searching parent for duplicate name
-	int blankDE_block = -1;
-	int blankDE_index = -1;
-
-	// Loop through parent + extents (if exist)
-	for (int i = -1; i < MAX_EXTENTS; i++) {
-		int blockLocation = 0;	// location in volume to read from
-		
-		if (i == -1)	// block location is parent location
-			blockLocation = parentDir->location;
-		else			// OR one of parent's extent locations
-			blockLocation = parentDir->extentLocations[i].blockNumber;
-
-		if (blockLocation <= 0)
-			continue;
-
-		// Loop through each DE
-		for (int j = 0; j < INIT_NUM_OF_DIRECT; j++) {
-			// Read 1 block into buffer array every 8 DE (at block location + offset), including 0
-			if (j % ENTRIES_PER_BLOCK == 0)
-				LBAread(buffBlockDE, 1, blockLocation + (j / ENTRIES_PER_BLOCK));
-
-			directoryEntry * currEntry = &(buffBlockDE[j % ENTRIES_PER_BLOCK]);
-
-			// If duplicate DE name found, exit with -1
-			if (!strcmp(currEntry->name, newDirecName)) {
-				free(buffBlockDE);
-				return -1;
-			}
-
-			// If blank DE found (when location == -1)
-			// AND a blank DE not found yet
-			// THEN note current extent and DE index of that extent
-			//		ext = -1 if initial volume of parent DEs
-			if (blankDE_index < 0 && currEntry->date == -1) {
-				blankDE_block = blockLocation + (j / ENTRIES_PER_BLOCK);
-				blankDE_index = j % ENTRIES_PER_BLOCK;
-			}
-		}
+	// The dentry cache or the parent's name filter answers most duplicate checks without
+	// any reads; the rest go to the parent's index, or a scan of every block of it
+	directoryEntry cachedEntry;
+	int cached = dentryCacheLookup(parentDir->location, newDirecName, &cachedEntry);
+	if (cached == 1 || (cached == 0 && dentryCacheMayContain(parentDir->location, newDirecName) != 0 &&
+			findDirEntry(parentDir->location, newDirecName, NULL, NULL, NULL) == 0)) {
+		free(buffBlockDE);
+		return -1;
 	}
 
-	// If no blank DE found, find a free extent to allocate towards and use that first DE
-	if (blankDE_index < 0) {
-		int freeExtent = -1;
-
-		// Find free extent
-		for (int i = 0; i < MAX_EXTENTS; i++) {
-			if (parentDir->extentLocations[i].blockNumber <= 0) {
-				freeExtent = i;
-				break;
-			}
-		}
-		// If no free extents found, exit with -2
-		if (freeExtent < 0) {
-			free(buffBlockDE);
-			return -2;
-		}
-		
-		// Allocate new blocks
-		int alloLoc =  allocateFirstBlocks(INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK);
-		// If no blocks can be allocated, exit with -3
-		if (alloLoc < 0) {
-			free(buffBlockDE);
-			return -3;
-		}
-		
-		// Update newly allocated extent for parent
-		parentDir->extentLocations[freeExtent].blockNumber = alloLoc;
-		parentDir->extentLocations[freeExtent].count = INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK;
-
-		// Fill every DE of the newly allocated extent with free DEs
-		directoryEntry * tempBuffer = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
-		for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-			createEntry(&(tempBuffer[i % ENTRIES_PER_BLOCK]), "", false, 0, -1, -1);
-			
-			// Write to volume every 8 entries
-			if (i % ENTRIES_PER_BLOCK == ENTRIES_PER_BLOCK - 1)
-				LBAwrite(tempBuffer, 1, alloLoc + (i / ENTRIES_PER_BLOCK));
-		}
-
-		// Update parent's size
-		LBAread(tempBuffer, 1, parentDir->location);
-		tempBuffer[0].fileSize += INIT_NUM_OF_DIRECT * DE_SIZE;
-		LBAwrite(tempBuffer, 1, parentDir->location);
-		parentDir->fileSize += INIT_NUM_OF_DIRECT * DE_SIZE;
-
-		free(tempBuffer);
+	// Both allocations below only touch the in-memory bitmap; the changed
+	// bitmap blocks are written once when the transaction ends
+	beginMapTransaction();
 
-		blankDE_block = alloLoc;
-		blankDE_index = 0;
+	/// FIND A BLANK DE TO FILL, growing the parent when every DE is in use
+	// If the parent could not grow, exit with -2
+	int64_t blankDE_block = -1;
+	int blankDE_index = -1;
+	if (findFreeDirSlot(parentDir->location, &blankDE_block, &blankDE_index) < 0) {
+		free(buffBlockDE);
+		endMapTransaction();
+		return -2;
 	}
 
 	/// CHECK FOR USEABLE FREE BLOCKS
 	// Allocate blocks for new DE: if no blocks available, exit with -2
-	int mapLocation = allocateFirstBlocks(INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK);
+	// 		(the parent's location is the goal so the new directory lands in its allocation group)
+	int mapLocation = allocateBlocksNear(INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK, parentDir->location);
 	if (mapLocation == -1) {
 		free(buffBlockDE);
+		endMapTransaction();
 		return -2;
 	}
+	endMapTransaction();
 
 	for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
 		directoryEntry * currEntry = &(buffBlockDE[i % ENTRIES_PER_BLOCK]);
 
 		// create DE for Directory we are creating (selfDE)
 		if (i == 0) {
-			createEntry(currEntry, ".", true, DE_SIZE * INIT_NUM_OF_DIRECT, time(0), mapLocation);
-
-			// Read from volume to temp buffer the block a free DE was found at
-			//		AKA the block to edit
-			directoryEntry * tempBuffer = (directoryEntry *)calloc(ENTRIES_PER_BLOCK, DE_SIZE);
-			LBAread(tempBuffer, 1, blankDE_block);
-
-			// Copy memory of selfDE to the entry in block
-			memcpy(&(tempBuffer[blankDE_index]), currEntry, DE_SIZE);
-			strncpy(tempBuffer[blankDE_index].name, newDirecName, sizeof(currEntry->name));	// but give it the new name
-
-			// Write to volume the updated block
-			LBAwrite(tempBuffer, 1, blankDE_block);
-
-			free(tempBuffer);	// free the temp buffer
+			createEntry(currEntry, ".", true, DIR_SIZE, time(0), mapLocation);
+
+			// Copy selfDE to the free DE of the parent, but give it the new name
+			directoryEntry namedEntry;
+			memcpy(&namedEntry, currEntry, DE_SIZE);
+			strncpy(namedEntry.name, newDirecName, sizeof(namedEntry.name) - 1);
+			namedEntry.name[sizeof(namedEntry.name) - 1] = '\0';
+
+			// Write to volume the updated entry; with an inode table it is given the
+			// directory's inode, which selfDE shares
+			if (writeDirEntry(blankDE_block, blankDE_index, &namedEntry) < 0) {
+				clearBlocks(mapLocation, INIT_NUM_OF_DIRECT / ENTRIES_PER_BLOCK);
+				free(buffBlockDE);
+				return -2;
+			}
+			currEntry->inode = namedEntry.inode;
 		}
 		// create DE for parent directory
 		else if (i == 1) {
@@ -183,11 +182,15 @@ int createDirectory(directoryEntry* parentDir, char* newDirecName) {
 		
 		// Write buffer to volume at end of every (ENTRIES_PER_BLOCK)th iteration
 		if (i % ENTRIES_PER_BLOCK == ENTRIES_PER_BLOCK - 1)
-			LBAwrite(buffBlockDE, 1, mapLocation + (i / ENTRIES_PER_BLOCK));
+			writeEntries(buffBlockDE, 1, mapLocation + (i / ENTRIES_PER_BLOCK), 1);
 	}
 
 	free(buffBlockDE);
 
+	// the parent's index learns the new name last, once every write of its first block is done
+	dirIndexAdd(parentDir->location, newDirecName, blankDE_block, blankDE_index);
+	dentryCacheCreated(parentDir->location, newDirecName);
+
 	return mapLocation;
 }
 
@@ -207,7 +210,7 @@ int initRootDirectory() {
 				entry,									// current entry
 				(i == 0 ? "." : ".."),					// self or parent name
 				true,									// is a direc
-				DE_SIZE * INIT_NUM_OF_DIRECT,			// size of root
+				DIR_SIZE,								// size of root
 				(i == 1 ? dEntries[0].date : time(0)),	// date created, or copy self entry
 				mapLocation								// location in volume
 			);
@@ -224,27 +227,603 @@ int initRootDirectory() {
             createEntry(entry, "", false, 0, -1, -1);
     }
 
-	LBAwrite(dEntries, numBlocks, mapLocation);
+	// the root is its own parent, so both entries name the same inode
+	inodeAlloc(&dEntries[0]);
+	dEntries[1].inode = dEntries[0].inode;
+	writeEntries(dEntries, numBlocks, mapLocation, 1);
 
 	return mapLocation;
 }
 
+int entryBlocksAtMainLoc(directoryEntry* entry) {
+	if (entry->location <= 0)
+		return 0;
+
+	// the extent tree maps every run, the first one included
+	if (entry->extentLocations[0].count == EXTENT_TREE_MARKER)
+		return 0;
+
+	// preallocated: the first run is extent 0
+	if (entry->extentLocations[0].count > 0 && entry->extentLocations[0].blockNumber == entry->location)
+		return 0;
+
+	// otherwise the size says how many blocks there are, minus those held by extents
+	int blocks = (entry->fileSize + vcbPointer->blockSize - 1) / vcbPointer->blockSize;
+	for (int i = 0; i < MAX_EXTENTS; i++) {
+		if (entry->extentLocations[i].count > 0)
+			blocks -= entry->extentLocations[i].count;
+	}
+	return (blocks > 0) ? blocks : 0;
+}
+
+int releaseEntryBlocks(directoryEntry* entry) {
+	// free every run first, then write the changed bitmap blocks once
+	beginMapTransaction();
+
+	int mainBlocks = entryBlocksAtMainLoc(entry);
+	if (mainBlocks > 0)
+		clearBlocks(entry->location, mainBlocks);
+
+	// every data run and node of an extent tree
+	if (entry->extentLocations[0].count == EXTENT_TREE_MARKER)
+		extentTreeRelease(entry->extentLocations[0].blockNumber);
+
+	for (int i = 0; i < MAX_EXTENTS; i++) {
+		extent * ext = &(entry->extentLocations[i]);
+		if (ext->count > 0)
+			clearBlocks(ext->blockNumber, ext->count);
+		ext->blockNumber = 0;
+		ext->count = 0;
+	}
+
+	endMapTransaction();
+
+	entry->location = -1;
+	return 0;
+}
+
+void refreshDirectory(directoryEntry* dir) {
+	if (!dir->isDirectory || dir->location <= 0)
+		return;
+
+	directoryEntry self;
+	if (readDirEntry(dir->location, 0, &self) < 0)
+		return;
+	dir->fileSize = self.fileSize;
+	memcpy(dir->extentLocations, self.extentLocations, sizeof(extent) * MAX_EXTENTS);
+}
+
+int findDirEntry(int64_t dirLocation, const char* name, directoryEntry* out, int64_t* blockOut, int* indexOut) {
+	int indexed = dirIndexLookup(dirLocation, name, out, blockOut, indexOut);
+	if (indexed >= 0)
+		return (indexed == 1) ? 0 : -1;
+
+	dirCursor cursor;
+	dirRecord * records = (dirRecord *)calloc(ENTRIES_PER_BLOCK, sizeof(dirRecord));
+	if (records == NULL || dirCursorOpen(&cursor, dirLocation) < 0) {
+		free(records);
+		return -1;
+	}
+
+	// a miss reads every name anyway, so it leaves the directory a name filter for free
+	int filtering = dentryCacheFilterStart(dirLocation, cursor.blocks);
+
+	// every block of the directory, its first run and each one after it; only the
+	// names are compared, so with an inode table just the match's inode is read
+	int64_t lba;
+	while ((lba = dirCursorNext(&cursor)) >= 0) {
+		readDirRecords(records, 1, lba);
+
+		for (int j = 0; j < ENTRIES_PER_BLOCK; j++) {
+			if (records[j].inode == 0 || records[j].name[0] == '\0')
+				continue;
+			if (strcmp(records[j].name, name) == 0) {
+				free(records);
+				if (filtering)
+					dentryCacheFilterFinish(0);
+				if (out != NULL && readDirEntry(lba, j, out) < 0)
+					return -1;
+				if (blockOut != NULL)
+					*blockOut = lba;
+				if (indexOut != NULL)
+					*indexOut = j;
+				return 0;
+			}
+			if (filtering)
+				dentryCacheFilterName(records[j].name);
+		}
+	}
+
+	free(records);
+	if (filtering)
+		dentryCacheFilterFinish(1);
+	return -1;
+}
+
+int findFreeDirSlot(int64_t dirLocation, int64_t* blockOut, int* indexOut) {
+	dirCursor cursor;
+	dirRecord * records = (dirRecord *)calloc(ENTRIES_PER_BLOCK, sizeof(dirRecord));
+	if (records == NULL || dirCursorOpen(&cursor, dirLocation) < 0) {
+		fprintf(stderr, "Memory Allocation Error");
+		free(records);
+		return -1;
+	}
+
+	// every block before the hint is known to be full, so bulk creates do not rescan them
+	dirCursorSeek(&cursor, dentryCacheFreeHint(dirLocation));
+
+	int64_t lba;
+	while ((lba = dirCursorNext(&cursor)) >= 0) {
+		readDirRecords(records, 1, lba);
+
+		for (int j = 0; j < ENTRIES_PER_BLOCK; j++) {
+			if (records[j].inode == 0) {
+				dentryCacheSetFreeHint(dirLocation, cursor.block - 1);
+				*blockOut = lba;
+				*indexOut = j;
+				free(records);
+				return 0;
+			}
+		}
+	}
+	free(records);
+
+	// every entry is in use: the first new block is all free
+	int64_t newRun = growDirectory(dirLocation);
+	if (newRun < 0)
+		return -1;
+
+	dentryCacheSetFreeHint(dirLocation, cursor.blocks);
+	*blockOut = newRun;
+	*indexOut = 0;
+	return 0;
+}
+
+int64_t growDirectory(int64_t dirLocation) {
+	directoryEntry selfEntry;
+	if (readDirEntry(dirLocation, 0, &selfEntry) < 0)
+		return -1;
+	directoryEntry * self = &selfEntry;
+
+	// doubling keeps the number of runs (and of index rebuilds) logarithmic in the entries
+	int64_t blocks = dirBlockCount(self);
+	int64_t grow = blocks;
+	if (grow > DIR_GROW_MAX_BLOCKS)
+		grow = DIR_GROW_MAX_BLOCKS;
+	int64_t lastEnd = dirBlockToLBA(self, blocks - 1, NULL) + 1;
+
+	// free entries written in one request, before the directory points at them
+	directoryEntry * freeEntries = (directoryEntry *)calloc(grow * ENTRIES_PER_BLOCK, DE_SIZE);
+	if (freeEntries == NULL) {
+		fprintf(stderr, "Memory Allocation Error");
+		return -1;
+	}
+	for (int64_t i = 0; i < grow * ENTRIES_PER_BLOCK; i++)
+		createEntry(&(freeEntries[i]), "", false, 0, -1, -1);
+
+	beginMapTransaction();
+
+	int64_t newRun = allocateBlocksNear(grow, lastEnd);
+	if (newRun < 0) {
+		fprintf(stderr, "ERROR: Could not allocate blocks to grow the directory.\n");
+		endMapTransaction();
+		free(freeEntries);
+		return -1;
+	}
+	writeEntries(freeEntries, grow, newRun, 1);
+	free(freeEntries);
+
+	int result = 0;
+	if (self->extentLocations[0].count == EXTENT_TREE_MARKER) {
+		int64_t root = self->extentLocations[0].blockNumber;
+		extentRecord last;
+		if (newRun == lastEnd && extentTreeLast(root, &last) == 0) {
+			result = extentTreeSetLastCount(root, last.count + grow);
+		} else {
+			extentRecord run = {(int)blocks, (int)newRun, (int)grow};
+			int64_t newRoot = extentTreeAppend(root, &run);
+			if (newRoot < 0)
+				result = -1;
+			else
+				self->extentLocations[0].blockNumber = newRoot;
+		}
+	} else {
+		int lastExtent = -1;
+		for (int i = 0; i < MAX_EXTENTS; i++) {
+			if (self->extentLocations[i].count > 0)
+				lastExtent = i;
+		}
+
+		if (lastExtent >= 0 && newRun == lastEnd) {
+			// the blocks right after the last run were free
+			self->extentLocations[lastExtent].count += grow;
+		} else if (lastExtent + 1 < MAX_EXTENTS) {
+			self->extentLocations[lastExtent + 1].blockNumber = newRun;
+			self->extentLocations[lastExtent + 1].count = grow;
+		} else {
+			// out of extents: the first run, every extent and the new run go into a tree
+			extentRecord records[MAX_EXTENTS + 2];
+			int64_t fileBlock = MIN_BLOCKS_PER_DIR;
+			records[0] = (extentRecord){0, (int)dirLocation, MIN_BLOCKS_PER_DIR};
+			for (int i = 0; i < MAX_EXTENTS; i++) {
+				records[i + 1] = (extentRecord){(int)fileBlock, (int)self->extentLocations[i].blockNumber,
+					(int)self->extentLocations[i].count};
+				fileBlock += self->extentLocations[i].count;
+			}
+			records[MAX_EXTENTS + 1] = (extentRecord){(int)fileBlock, (int)newRun, (int)grow};
+
+			int64_t root = extentTreeBuild(records, MAX_EXTENTS + 2, dirLocation);
+			if (root < 0) {
+				result = -1;
+			} else {
+				memset(self->extentLocations, 0, sizeof(extent) * MAX_EXTENTS);
+				self->extentLocations[0].blockNumber = root;
+				self->extentLocations[0].count = EXTENT_TREE_MARKER;
+			}
+		}
+	}
+
+	if (result < 0) {
+		fprintf(stderr, "ERROR: Could not record the directory's new run.\n");
+		clearBlocks(newRun, grow);
+		endMapTransaction();
+		return -1;
+	}
+
+	self->fileSize += grow * vcbPointer->blockSize;
+	writeDirEntry(dirLocation, 0, self);
+
+	// past its first run a directory is worth an index; built from what is on disk,
+	// the entry the caller is about to write in the new run is added to it after
+	if (self->indexLocation <= 0 && dirIndexBuild(self) == 0 && self->indexLocation > 0)
+		writeDirEntry(dirLocation, 0, self);
+	endMapTransaction();
+
+	return newRun;
+}
+
+int64_t dirBlockCount(directoryEntry* self) {
+	if (self->extentLocations[0].count == EXTENT_TREE_MARKER)
+		return extentTreeBlocks(self->extentLocations[0].blockNumber);
+
+	int64_t blocks = MIN_BLOCKS_PER_DIR;
+	for (int i = 0; i < MAX_EXTENTS; i++) {
+		if (self->extentLocations[i].count > 0)
+			blocks += self->extentLocations[i].count;
+	}
+	return blocks;
+}
+
+int64_t dirBlockToLBA(directoryEntry* self, int64_t dirBlock, int64_t* runLeft) {
+	if (dirBlock < 0)
+		return -1;
+
+	// the tree maps every run, the first one included
+	if (self->extentLocations[0].count == EXTENT_TREE_MARKER) {
+		extentRecord run;
+		if (extentTreeLookup(self->extentLocations[0].blockNumber, dirBlock, &run) < 0)
+			return -1;
+		if (runLeft != NULL)
+			*runLeft = run.fileBlock + run.count - dirBlock;
+		return run.blockNumber + (dirBlock - run.fileBlock);
+	}
+
+	if (dirBlock < MIN_BLOCKS_PER_DIR) {
+		if (runLeft != NULL)
+			*runLeft = MIN_BLOCKS_PER_DIR - dirBlock;
+		return self->location + dirBlock;
+	}
+	dirBlock -= MIN_BLOCKS_PER_DIR;
+
+	for (int i = 0; i < MAX_EXTENTS; i++) {
+		extent * ext = &(self->extentLocations[i]);
+		if (ext->count <= 0)
+			break;
+		if (dirBlock < ext->count) {
+			if (runLeft != NULL)
+				*runLeft = ext->count - dirBlock;
+			return ext->blockNumber + dirBlock;
+		}
+		dirBlock -= ext->count;
+	}
+	return -1;
+}
+
+int dirCursorOpen(dirCursor* cursor, int64_t dirLocation) {
+	if (readDirEntry(dirLocation, 0, &(cursor->self)) < 0)
+		return -1;
+
+	// a directory's "." entry always points at the directory itself
+	cursor->self.location = dirLocation;
+	cursor->blocks = dirBlockCount(&(cursor->self));
+	dirCursorSeek(cursor, 0);
+	return 0;
+}
+
+void dirCursorSeek(dirCursor* cursor, int64_t dirBlock) {
+	cursor->block = dirBlock;
+	cursor->lba = -1;
+	cursor->runLeft = 0;
+}
+
+int64_t dirCursorNext(dirCursor* cursor) {
+	if (cursor->block < 0 || cursor->block >= cursor->blocks)
+		return -1;
+
+	// one mapping per run, then consecutive blocks
+	if (cursor->runLeft <= 0) {
+		cursor->lba = dirBlockToLBA(&(cursor->self), cursor->block, &(cursor->runLeft));
+		if (cursor->lba < 0)
+			return -1;
+	}
+
+	int64_t lba = cursor->lba;
+	cursor->lba++;
+	cursor->runLeft--;
+	cursor->block++;
+	return lba;
+}
+
+uint64_t readDirRecords(dirRecord* records, uint64_t blocks, uint64_t location) {
+	// records are what a volume with an inode table stores, ENTRIES_PER_BLOCK to a block
+	if (vcbPointer->features & VCB_FEATURE_INODES) {
+		char* raw = malloc(blocks * vcbPointer->blockSize);
+		if (raw == NULL) {
+			fprintf(stderr, "Memory Allocation Error");
+			return 0;
+		}
+		uint64_t result = cachedLBAread(raw, blocks, location);
+		for (uint64_t b = 0; b < blocks; b++)
+			memcpy(&records[b * ENTRIES_PER_BLOCK], raw + b * vcbPointer->blockSize, ENTRIES_PER_BLOCK * sizeof(dirRecord));
+		free(raw);
+		return result;
+	}
+
+	directoryEntry* entries = malloc(blocks * ENTRIES_PER_BLOCK * DE_SIZE);
+	if (entries == NULL) {
+		fprintf(stderr, "Memory Allocation Error");
+		return 0;
+	}
+
+	uint64_t result = readDirBlocks(entries, blocks, location);
+	for (uint64_t i = 0; i < blocks * ENTRIES_PER_BLOCK; i++) {
+		records[i].inode = (entries[i].date == -1) ? 0 : RECORD_NO_INODE;
+		memcpy(records[i].name, entries[i].name, sizeof(entries[i].name));
+	}
+
+	free(entries);
+	return result;
+}
+
+int readDirEntry(uint64_t location, int index, directoryEntry* out) {
+	if (vcbPointer->features & VCB_FEATURE_INODES) {
+		dirRecord* records = malloc(ENTRIES_PER_BLOCK * sizeof(dirRecord));
+		if (records == NULL) {
+			fprintf(stderr, "Memory Allocation Error");
+			return -1;
+		}
+		readDirRecords(records, 1, location);
+		int result = entryFromRecord(out, &records[index]);
+		free(records);
+		return result;
+	}
+
+	directoryEntry* entries = malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+	if (entries == NULL) {
+		fprintf(stderr, "Memory Allocation Error");
+		return -1;
+	}
+	readDirBlocks(entries, 1, location);
+	memcpy(out, &entries[index], sizeof(directoryEntry));
+	free(entries);
+	return 0;
+}
+
+int writeDirEntry(uint64_t location, int index, directoryEntry* entry) {
+	if (vcbPointer->features & VCB_FEATURE_INODES) {
+		// the block's other records, and their inodes, stay as they are
+		char* raw = malloc(vcbPointer->blockSize);
+		if (raw == NULL) {
+			fprintf(stderr, "Memory Allocation Error");
+			return -1;
+		}
+		cachedLBAread(raw, 1, location);
+		if (storeRecord(&((dirRecord*)raw)[index], entry) < 0) {
+			free(raw);
+			return -1;
+		}
+		cachedLBAwrite(raw, 1, location);
+		free(raw);
+		return 0;
+	}
+
+	directoryEntry* entries = malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+	if (entries == NULL) {
+		fprintf(stderr, "Memory Allocation Error");
+		return -1;
+	}
+	readDirBlocks(entries, 1, location);
+	memcpy(&entries[index], entry, sizeof(directoryEntry));
+	uint64_t written = writeDirBlocks(entries, 1, location);
+	free(entries);
+	return (written == 1) ? 0 : -1;
+}
+
+uint64_t readDirBlocks(directoryEntry* entries, uint64_t blocks, uint64_t location) {
+	if (vcbPointer->features & VCB_FEATURE_INODES) {
+		dirRecord* records = malloc(blocks * ENTRIES_PER_BLOCK * sizeof(dirRecord));
+		if (records == NULL) {
+			fprintf(stderr, "Memory Allocation Error");
+			return 0;
+		}
+		uint64_t result = readDirRecords(records, blocks, location);
+		for (uint64_t i = 0; i < blocks * ENTRIES_PER_BLOCK; i++)
+			entryFromRecord(&entries[i], &records[i]);
+		free(records);
+		return result;
+	}
+
+	if (vcbPointer->features & VCB_FEATURE_WIDE_ENTRIES) {
+		// read straight into the buffer, then spread the entries out from the last one
+		// down, so none is overwritten before it has moved
+		uint64_t result = cachedLBAread(entries, blocks, location);
+		for (int64_t i = blocks * ENTRIES_PER_BLOCK - 1; i >= 0; i--) {
+			memmove(&entries[i], (char*)entries + i * DE_SIZE_V2, DE_SIZE_V2);
+			entries[i].inode = 0;
+		}
+		return result;
+	}
+
+	directoryEntryV1* oldEntries = malloc(blocks * vcbPointer->blockSize);
+	if (oldEntries == NULL) {
+		fprintf(stderr, "Memory Allocation Error");
+		return 0;
+	}
+
+	uint64_t result = cachedLBAread(oldEntries, blocks, location);
+	for (uint64_t i = 0; i < blocks * ENTRIES_PER_BLOCK; i++)
+		entryFromV1(&entries[i], &oldEntries[i]);
+
+	free(oldEntries);
+	return result;
+}
+
+uint64_t writeDirBlocks(directoryEntry* entries, uint64_t blocks, uint64_t location) {
+	return writeEntries(entries, blocks, location, 0);
+}
+
+static uint64_t writeEntries(directoryEntry* entries, uint64_t blocks, uint64_t location, int fresh) {
+	char* raw = calloc(blocks, vcbPointer->blockSize);
+	if (raw == NULL) {
+		fprintf(stderr, "Memory Allocation Error");
+		return 0;
+	}
+
+	if (vcbPointer->features & VCB_FEATURE_INODES) {
+		// the records being replaced say which links go away
+		if (!fresh)
+			cachedLBAread(raw, blocks, location);
+
+		for (uint64_t i = 0; i < blocks * ENTRIES_PER_BLOCK; i++) {
+			dirRecord* record = (dirRecord*)(raw + (i / ENTRIES_PER_BLOCK) * vcbPointer->blockSize) + i % ENTRIES_PER_BLOCK;
+			if (storeRecord(record, &entries[i]) < 0) {
+				fprintf(stderr, "ERROR: %s could not be given an inode\n", entries[i].name);
+				free(raw);
+				return 0;
+			}
+		}
+	} else if (vcbPointer->features & VCB_FEATURE_WIDE_ENTRIES) {
+		for (uint64_t i = 0; i < blocks * ENTRIES_PER_BLOCK; i++)
+			memcpy(raw + i * DE_SIZE_V2, &entries[i], DE_SIZE_V2);
+	} else {
+		// nothing is written if any entry would be cut short
+		directoryEntryV1* oldEntries = (directoryEntryV1*)raw;
+		for (uint64_t i = 0; i < blocks * ENTRIES_PER_BLOCK; i++) {
+			if (entryToV1(&oldEntries[i], &entries[i]) < 0) {
+				fprintf(stderr, "ERROR: %s does not fit a v1 directory entry\n", entries[i].name);
+				free(raw);
+				return 0;
+			}
+		}
+	}
+
+	uint64_t result = cachedLBAwrite(raw, blocks, location);
+	free(raw);
+	return result;
+}
+
+static int isDotName(const char* name) {
+	return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+static int entryFromRecord(directoryEntry* entry, dirRecord* record) {
+	if (record->inode == 0 || inodeLoad(entry, record->inode) < 0) {
+		createEntry(entry, "", false, 0, -1, -1);
+		return (record->inode == 0) ? 0 : -1;
+	}
+	memcpy(entry->name, record->name, sizeof(entry->name));
+	entry->name[sizeof(entry->name) - 1] = '\0';
+	return 0;
+}
+
+static int storeRecord(dirRecord* record, directoryEntry* entry) {
+	int isFree = (entry->date == -1);
+
+	if (!isFree && entry->inode == 0) {
+		// a new name for a new file or directory; ".." only ever names an existing one
+		if (strcmp(entry->name, "..") == 0 || inodeAlloc(entry) < 0)
+			return -1;
+	} else if (!isFree && (!entry->isDirectory || strcmp(entry->name, ".") == 0)) {
+		// a directory's inode is written from its "." entry only: the entry in its
+		// parent and its children's ".." entries may be older copies
+		if (inodeStore(entry) < 0)
+			return -1;
+	}
+
+	// the new link is added before the old one goes, so a name moved within
+	// the directory never frees its inode
+	int64_t oldLink = isDotName(record->name) ? 0 : record->inode;
+	int64_t newLink = (isFree || isDotName(entry->name)) ? 0 : entry->inode;
+	if (oldLink != newLink) {
+		if (newLink != 0)
+			inodeLink(newLink, 1);
+		if (oldLink != 0)
+			inodeLink(oldLink, -1);
+	}
+
+	memset(record, 0, sizeof(dirRecord));
+	if (!isFree) {
+		record->inode = entry->inode;
+		strncpy(record->name, entry->name, sizeof(entry->name) - 1);
+	}
+	return 0;
+}
+
+static void entryFromV1(directoryEntry* entry, directoryEntryV1* old) {
+	memset(entry, 0, sizeof(directoryEntry));
+	entry->date = old->date;
+	entry->fileSize = old->fileSize;
+	entry->location = old->location;
+	entry->isDirectory = old->isDirectory;
+	memcpy(entry->name, old->name, sizeof(entry->name));
+
+	for (int i = 0; i < MAX_EXTENTS; i++) {
+		entry->extentLocations[i].blockNumber = old->extentLocations[i].blockNumber;
+		entry->extentLocations[i].count = old->extentLocations[i].count;
+	}
+}
+
+static int entryToV1(directoryEntryV1* old, directoryEntry* entry) {
+	if (entry->fileSize > UINT32_MAX || entry->location > SHRT_MAX || entry->location < SHRT_MIN)
+		return -1;
+
+	old->date = entry->date;
+	old->fileSize = entry->fileSize;
+	old->location = entry->location;
+	old->isDirectory = entry->isDirectory;
+	memcpy(old->name, entry->name, sizeof(old->name));
+
+	for (int i = 0; i < MAX_EXTENTS; i++) {
+		extent* ext = &(entry->extentLocations[i]);
+		if (ext->blockNumber > SHRT_MAX || ext->blockNumber < SHRT_MIN || ext->count > SHRT_MAX || ext->count < SHRT_MIN)
+			return -1;
+		old->extentLocations[i].blockNumber = ext->blockNumber;
+		old->extentLocations[i].count = ext->count;
+	}
+	return 0;
+}
+
 // For debug purposes for now
 directoryEntry* readDirectory(int location, int blocks) {
-	// directoryEntry
-	// 		char name[27];
-	// 		bool isDirectory;
-	// 		uint32_t fileSize;
-	// 		time_t date;
-	// 		extent location[3];
-	
-	directoryEntry* dEntries[INIT_NUM_OF_DIRECT];
+	directoryEntry* dEntries = calloc(blocks * ENTRIES_PER_BLOCK, DE_SIZE);
 
-	LBAread(dEntries, blocks, location);
+	readDirBlocks(dEntries, blocks, location);
 
 	// Debug
-	for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-		directoryEntry * entry = dEntries[i];
-		printf("%d. [%s][%ld][%d][%d][%d][%d]\n", i, entry->name, entry->date, entry->fileSize, entry->isDirectory, entry->extentLocations[0].blockNumber, entry->extentLocations[0].count);
+	for (int i = 0; i < blocks * ENTRIES_PER_BLOCK; i++) {
+		directoryEntry * entry = &dEntries[i];
+		printf("%d. [%s][%ld][%lu][%d][%ld][%ld]\n", i, entry->name, entry->date, entry->fileSize, entry->isDirectory, entry->extentLocations[0].blockNumber, entry->extentLocations[0].count);
 	}
+
+	return dEntries;
 }
@@ -7,7 +7,9 @@
  * File: directoryEntry.h
  *
  * Description: Header file for directory, includes exposed functions: initRootDirectory(), createDirectory
- * createEntry, readDirectory
+ * createEntry, refreshDirectory, findDirEntry, findFreeDirSlot, growDirectory, dirBlockCount,
+ * dirBlockToLBA, dirCursorOpen, dirCursorSeek, dirCursorNext, readDirRecords, readDirEntry, writeDirEntry,
+ * readDirBlocks, writeDirBlocks, readDirectory
  * 
  * 
  *
@@ -19,16 +21,29 @@
 #include <stdint.h>
 #include <time.h>
 #include "bitmap.h"
+#include "vcb.h"
 
 // Macros
-#define INIT_NUM_OF_DIRECT 56 // Initial number of directory entries - 56
+#define MIN_NUM_OF_DIRECT 56 // Fewest entries a directory (or a new directory run) holds
 #define MAX_EXTENTS 3
-#define LBA_ROOT_LOC 6
-#define ENTRIES_PER_BLOCK 8
-#define DE_SIZE 64
-#define MIN_BLOCKS_PER_DIR 7
+#define LBA_ROOT_LOC (vcbPointer->rootLocation) // follows the bitmap, whose size depends on the volume
+#define DE_SIZE ((int)sizeof(directoryEntry))   // size of an entry in memory
+#define DE_SIZE_V1 64                           // size of an entry on a v1 volume
+#define DE_SIZE_V2 128                          // size of an entry on a v2 volume
+#define DE_SIZE_RECORD ((int)sizeof(dirRecord)) // size of an entry on a volume with an inode table
+#define DE_DISK_SIZE ((vcbPointer->features & VCB_FEATURE_INODES) ? DE_SIZE_RECORD : \
+	(vcbPointer->features & VCB_FEATURE_WIDE_ENTRIES) ? DE_SIZE_V2 : DE_SIZE_V1)
+#define ENTRIES_PER_BLOCK (vcbPointer->blockSize / DE_DISK_SIZE)
+#define MIN_BLOCKS_PER_DIR ((MIN_NUM_OF_DIRECT + ENTRIES_PER_BLOCK - 1) / ENTRIES_PER_BLOCK)
+#define INIT_NUM_OF_DIRECT (MIN_BLOCKS_PER_DIR * ENTRIES_PER_BLOCK) // Initial number of directory entries, whole blocks of them
+#define DIR_SIZE (MIN_BLOCKS_PER_DIR * vcbPointer->blockSize)  // bytes on disk of a directory's first run
+#define RECORD_NO_INODE -1  // dirRecord inode of an entry in use on a volume without an inode table
+#define DIR_GROW_MAX_BLOCKS 256 // A full directory doubles, but never grows by more than this many blocks at once
 
 // Entry in directory
+// Everything up to the inode field is also the v2 on-disk layout; v1 volumes store the
+// narrower layout in directoryEntry.c, volumes with an inode table store a dirRecord and
+// an inode (see inode.h), and readDirBlocks()/writeDirBlocks() convert
 typedef struct directoryEntry {
     // Date entry was created
     // Known free state value: -1
@@ -36,16 +51,16 @@ typedef struct directoryEntry {
 
     // Size of entry
     // Known free state value: 0
-    uint32_t fileSize; // 4 bytes
+    uint64_t fileSize; // 8 bytes
 
     // Extents pointing to entry location in volume
     //      Extent:
     //          blockNumber - block location
     //          count - number of blocks
-    extent extentLocations[MAX_EXTENTS]; // 12 bytes (assuming short blockNumber and count)
+    extent extentLocations[MAX_EXTENTS]; // 48 bytes (int64_t blockNumber and count)
 
     // Location
-    short location; // 2 bytes (short)
+    int64_t location; // 8 bytes
 
     // Whether entry is a directory
     // Known free state value: false
@@ -54,8 +69,40 @@ typedef struct directoryEntry {
     // Name of entry
     // Known free state value: ""
     char name[37]; // 37 bytes
+
+    // Hash index of the directory's names (see dirIndex.h), only kept in its "." entry
+    // Known free state value: 0 (no index, the directory is scanned)
+    int64_t indexLocation; // 8 bytes (after 2 bytes of padding)
+    int indexBlocks; // 4 bytes
+    int indexUsed; // 4 bytes, slots filled since the index was built
+
+    // Inode holding everything but the name on a volume with an inode table, not stored in the entry
+    // Known free state value: 0 (also the value on every other volume)
+    int64_t inode; // 8 bytes
 } directoryEntry;
 
+// Name of an entry and where the rest of it is, all a lookup needs; this is also
+// the on-disk layout of an entry on a volume with an inode table
+typedef struct dirRecord {
+    // Inode number, or RECORD_NO_INODE on a volume without an inode table
+    // Known free state value: 0
+    int64_t inode; // 8 bytes
+
+    // Name of entry
+    // Known free state value: ""
+    char name[40]; // 37 bytes used, as in directoryEntry
+} dirRecord;
+
+// Position in a walk over a directory's blocks in order: its first run, then each
+// extent, or the runs of its extent tree once it has outgrown MAX_EXTENTS of them
+typedef struct dirCursor {
+    directoryEntry self;    // the directory's "." entry
+    int64_t block;          // index within the directory of the next block
+    int64_t blocks;         // blocks the directory has
+    int64_t lba;            // LBA of the next block while runLeft > 0
+    int64_t runLeft;        // blocks left in the current run
+} dirCursor;
+
 
 /**
  * Initialize the root directory, and write to volume
@@ -80,7 +127,7 @@ int createDirectory(directoryEntry* parentDir, char* newDirecName);
  * @param date date entry created
  * @param mapLocation location of entry
 */
-void createEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t size, time_t date, int mapLocation);
+void createEntry(directoryEntry* entry, char* name, bool isDirectory, uint64_t size, time_t date, int64_t mapLocation);
 
 /**
  * // Fill in entry info
@@ -92,7 +139,147 @@ void createEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t s
  * @param mapLocation location of entry
  * @param extents extent array pointer
 */
-void copyEntry(directoryEntry* entry, char* name, bool isDirectory, uint32_t size, time_t date, int mapLocation, extent* extents);
+void copyEntry(directoryEntry* entry, char* name, bool isDirectory, uint64_t size, time_t date, int64_t mapLocation, extent* extents);
+
+/**
+ * Number of blocks in the run at entry->location that is not described by an extent.
+ * Files preallocated with b_fallocate() record every run, the first one included,
+ * in their extents (extent 0 starts at location), and files with an extent tree
+ * record every run in the tree, so for them this is 0.
+ * @param entry directoryEntry pointer to a file or directory entry
+ * @return block count of the main location run
+*/
+int entryBlocksAtMainLoc(directoryEntry* entry);
+
+/**
+ * Give every block of an entry (main location, extents or extent tree) back to the bitmap
+ * and reset its location and extents; the caller writes the entry back
+ * @param entry directoryEntry pointer to the entry being deleted or truncated
+ * @return 0 on success
+*/
+int releaseEntryBlocks(directoryEntry* entry);
+
+/**
+ * Refresh a directory's size and extents from its "." entry, the only copy of them
+ * kept up to date as the directory grows (the entry in its parent is not)
+ * @param dir directoryEntry pointer to the directory, e.g. as returned by parsePath()
+*/
+void refreshDirectory(directoryEntry* dir);
+
+/**
+ * Find where an entry of a directory is stored, through the directory's hash index
+ * when it has one and by scanning every block of it otherwise
+ * @param dirLocation first block of the directory
+ * @param name name of the entry
+ * @param out if not NULL, receives the entry
+ * @param blockOut if not NULL, receives the block holding the entry
+ * @param indexOut if not NULL, receives the entry's position within that block
+ * @return 0 if found, -1 otherwise
+*/
+int findDirEntry(int64_t dirLocation, const char* name, directoryEntry* out, int64_t* blockOut, int* indexOut);
+
+/**
+ * Find a free entry in a directory, growing the directory when every entry is in use.
+ * Scanning starts from the first block that may have a free entry (see dentryCacheFreeHint())
+ * @param dirLocation first block of the directory
+ * @param blockOut receives the block holding the free entry
+ * @param indexOut receives the entry's position within that block
+ * @return 0 on success, -1 if the directory could not grow
+*/
+int findFreeDirSlot(int64_t dirLocation, int64_t* blockOut, int* indexOut);
+
+/**
+ * Add a run of free entries at the end of a directory, as many blocks as it already
+ * has (at most DIR_GROW_MAX_BLOCKS). The run extends the last one when the blocks after it
+ * are free, takes an unused extent otherwise, and moves every run into an extent tree
+ * once the extents are all in use. The "." entry is updated on disk
+ * @param dirLocation first block of the directory
+ * @return LBA of the first new block, or -1 if no blocks could be allocated
+*/
+int64_t growDirectory(int64_t dirLocation);
+
+/**
+ * @param self the directory's "." entry
+ * @return number of blocks in the directory, all of its runs included
+*/
+int64_t dirBlockCount(directoryEntry* self);
+
+/**
+ * Map a block index within a directory to its LBA
+ * @param self the directory's "." entry
+ * @param dirBlock index of the block within the directory
+ * @param runLeft if not NULL, receives the number of blocks from there to the end of that run
+ * @return LBA of the block, -1 if the directory has no such block
+*/
+int64_t dirBlockToLBA(directoryEntry* self, int64_t dirBlock, int64_t* runLeft);
+
+/**
+ * Start a walk over the blocks of a directory, reading its "." entry
+ * @param cursor cursor to fill in
+ * @param dirLocation first block of the directory
+ * @return 0 on success, -1 if the "." entry could not be read
+*/
+int dirCursorOpen(dirCursor* cursor, int64_t dirLocation);
+
+/**
+ * Move a walk to the given block index within the directory
+*/
+void dirCursorSeek(dirCursor* cursor, int64_t dirBlock);
+
+/**
+ * Advance a walk by one block
+ * @return LBA of the block, -1 past the last block; the block's index is cursor->block - 1
+*/
+int64_t dirCursorNext(dirCursor* cursor);
+
+/**
+ * Read the names of blocks of directory entries and the inode each one is in, without
+ * reading the inodes themselves
+ * @param records buffer for blocks * ENTRIES_PER_BLOCK records
+ * @param blocks number of blocks to read
+ * @param location first block to read
+ * @return number of blocks read
+*/
+uint64_t readDirRecords(dirRecord* records, uint64_t blocks, uint64_t location);
+
+/**
+ * Read one directory entry; on a volume with an inode table only its own inode is read
+ * @param location block holding the entry
+ * @param index position of the entry within the block
+ * @param out receives the entry
+ * @return 0 on success, -1 on failure
+*/
+int readDirEntry(uint64_t location, int index, directoryEntry* out);
+
+/**
+ * Write one directory entry over the one at location/index, the rest of the block unchanged
+ * @param location block holding the entry
+ * @param index position of the entry within the block
+ * @param entry the entry; a new one gets an inode on a volume with an inode table
+ * @return 0 on success, -1 on failure
+*/
+int writeDirEntry(uint64_t location, int index, directoryEntry* entry);
+
+/**
+ * Read blocks of directory entries, converting them from the layout the volume stores them in
+ * @param entries buffer for blocks * ENTRIES_PER_BLOCK entries (DE_SIZE each)
+ * @param blocks number of blocks to read
+ * @param location first block to read
+ * @return number of blocks read
+*/
+uint64_t readDirBlocks(directoryEntry* entries, uint64_t blocks, uint64_t location);
+
+/**
+ * Write blocks of directory entries, converting them to the layout the volume stores them in.
+ * On a volume with an inode table every entry that is not free gets its inode written
+ * (a directory only through its "." entry), a new entry without one is given one, and
+ * link counts follow the names that were added and removed
+ * @param entries blocks * ENTRIES_PER_BLOCK entries (DE_SIZE each)
+ * @param blocks number of blocks to write
+ * @param location first block to write
+ * @return number of blocks written, 0 if an entry does not fit the v1 layout or gets no inode
+*/
+uint64_t writeDirBlocks(directoryEntry* entries, uint64_t blocks, uint64_t location);
 
 /**
  * Read an entry back from the volume - used for debugging currently
@@ -0,0 +1,321 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: extentTree.c
+ *
+ * Description: on-disk B+tree of extent records for files with more runs
+ * than fit in a directoryEntry. Nodes are read and written one block at a
+ * time through the block cache, so a lookup costs one (usually cached) read
+ * per level.
+ *
+ **************************************************************/
+#include "extentTree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitmap.h"
+#include "vcb.h"
+#include "blockCache.h"
+#include "fsLow.h"
+
+#define EXTENT_NODE_MAGIC 0x45585452    // "EXTR"
+
+typedef struct indexEntry {
+    int fileBlock;      // first file block mapped below child
+    int child;          // LBA of the child node
+} indexEntry;
+
+typedef struct extentNode {
+    int magic;
+    short level;        // 0 for leaves
+    short numEntries;
+    char entries[];     // extentRecords in a leaf, indexEntries otherwise, up to the end of the block
+} extentNode;
+
+#define NODE_RECORDS(node) ((extentRecord*)(node)->entries)
+#define NODE_CHILDREN(node) ((indexEntry*)(node)->entries)
+
+// nodes fill a whole block, so the fan-out grows with the block size
+#define LEAF_RECORDS ((vcbPointer->blockSize - sizeof(extentNode)) / sizeof(extentRecord))
+#define INDEX_ENTRIES ((vcbPointer->blockSize - sizeof(extentNode)) / sizeof(indexEntry))
+
+/* FORWARD DECLARATION BLOCK */
+
+// Reads a node into a block sized buffer, NULL if it is not a tree node
+static extentNode* readNode(int lba);
+
+// Writes a node back and frees the buffer
+static void writeNode(extentNode* node, int lba);
+
+// Allocates and writes an empty node at the given level, returns its LBA or -1
+static int newNode(int level, int goal);
+
+/**
+ * Appends record under the node at lba, always to its rightmost leaf.
+ * When the node was full, a new sibling holding the record is created and
+ * its LBA and first file block are returned through sibling/siblingKey.
+ */
+static int appendAt(int lba, extentRecord* record, int* sibling, int* siblingKey);
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static extentNode* readNode(int lba) {
+    extentNode* node = malloc(vcbPointer->blockSize);
+    if (node == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return NULL;
+    }
+
+    cachedLBAread(node, 1, lba);
+    if (node->magic != EXTENT_NODE_MAGIC) {
+        fprintf(stderr, "ERROR: block %d is not an extent tree node\n", lba);
+        free(node);
+        return NULL;
+    }
+    return node;
+}
+
+static void writeNode(extentNode* node, int lba) {
+    cachedLBAwrite(node, 1, lba);
+    free(node);
+}
+
+static int newNode(int level, int goal) {
+    int lba = allocateBlocksNear(1, goal);
+    if (lba < 0)
+        return -1;
+
+    extentNode* node = calloc(1, vcbPointer->blockSize);
+    if (node == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        clearBlocks(lba, 1);
+        return -1;
+    }
+    node->magic = EXTENT_NODE_MAGIC;
+    node->level = level;
+    node->numEntries = 0;
+    writeNode(node, lba);
+    return lba;
+}
+
+int extentTreeBuild(extentRecord* records, int numRecords, int goal) {
+    int root = newNode(0, goal);
+    for (int i = 0; i < numRecords && root >= 0; i++)
+        root = extentTreeAppend(root, &records[i]);
+    return root;
+}
+
+int extentTreeLookup(int root, int fileBlock, extentRecord* out) {
+    int lba = root;
+    while (1) {
+        extentNode* node = readNode(lba);
+        if (node == NULL)
+            return -1;
+
+        // last entry starting at or before fileBlock
+        int lo = 0;
+        int hi = node->numEntries - 1;
+        int found = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            int start = (node->level == 0) ? NODE_RECORDS(node)[mid].fileBlock : NODE_CHILDREN(node)[mid].fileBlock;
+            if (start <= fileBlock) {
+                found = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+
+        if (found < 0) {
+            free(node);
+            return -1;
+        }
+
+        if (node->level == 0) {
+            extentRecord rec = NODE_RECORDS(node)[found];
+            free(node);
+            if (fileBlock >= rec.fileBlock + rec.count)
+                return -1;
+            *out = rec;
+            return 0;
+        }
+
+        lba = NODE_CHILDREN(node)[found].child;
+        free(node);
+    }
+}
+
+int extentTreeLast(int root, extentRecord* out) {
+    int lba = root;
+    while (1) {
+        extentNode* node = readNode(lba);
+        if (node == NULL)
+            return -1;
+
+        if (node->numEntries == 0) {
+            free(node);
+            return -1;
+        }
+
+        if (node->level == 0) {
+            *out = NODE_RECORDS(node)[node->numEntries - 1];
+            free(node);
+            return 0;
+        }
+
+        lba = NODE_CHILDREN(node)[node->numEntries - 1].child;
+        free(node);
+    }
+}
+
+int extentTreeSetLastCount(int root, int count) {
+    int lba = root;
+    while (1) {
+        extentNode* node = readNode(lba);
+        if (node == NULL || node->numEntries == 0) {
+            free(node);
+            return -1;
+        }
+
+        if (node->level == 0) {
+            NODE_RECORDS(node)[node->numEntries - 1].count = count;
+            writeNode(node, lba);
+            return 0;
+        }
+
+        lba = NODE_CHILDREN(node)[node->numEntries - 1].child;
+        free(node);
+    }
+}
+
+static int appendAt(int lba, extentRecord* record, int* sibling, int* siblingKey) {
+    *sibling = -1;
+
+    extentNode* node = readNode(lba);
+    if (node == NULL)
+        return -1;
+
+    if (node->level == 0) {
+        if (node->numEntries < (int)LEAF_RECORDS) {
+            NODE_RECORDS(node)[node->numEntries++] = *record;
+            writeNode(node, lba);
+            return 0;
+        }
+        free(node);
+
+        // full leaf: the record starts the next one
+        int leaf = newNode(0, lba);
+        if (leaf < 0)
+            return -1;
+        extentNode* next = readNode(leaf);
+        if (next == NULL)
+            return -1;
+        NODE_RECORDS(next)[next->numEntries++] = *record;
+        writeNode(next, leaf);
+
+        *sibling = leaf;
+        *siblingKey = record->fileBlock;
+        return 0;
+    }
+
+    int level = node->level;
+    int child = NODE_CHILDREN(node)[node->numEntries - 1].child;
+    free(node);
+
+    int childSibling, childKey;
+    if (appendAt(child, record, &childSibling, &childKey) < 0)
+        return -1;
+    if (childSibling < 0)
+        return 0;
+
+    // the child split: link the new node here, or in a new sibling of ours
+    node = readNode(lba);
+    if (node == NULL)
+        return -1;
+    if (node->numEntries < (int)INDEX_ENTRIES) {
+        NODE_CHILDREN(node)[node->numEntries].fileBlock = childKey;
+        NODE_CHILDREN(node)[node->numEntries].child = childSibling;
+        node->numEntries++;
+        writeNode(node, lba);
+        return 0;
+    }
+    free(node);
+
+    int index = newNode(level, lba);
+    if (index < 0)
+        return -1;
+    extentNode* next = readNode(index);
+    if (next == NULL)
+        return -1;
+    NODE_CHILDREN(next)[0].fileBlock = childKey;
+    NODE_CHILDREN(next)[0].child = childSibling;
+    next->numEntries = 1;
+    writeNode(next, index);
+
+    *sibling = index;
+    *siblingKey = childKey;
+    return 0;
+}
+
+int extentTreeAppend(int root, extentRecord* record) {
+    int sibling, siblingKey;
+    if (appendAt(root, record, &sibling, &siblingKey) < 0)
+        return -1;
+    if (sibling < 0)
+        return root;
+
+    // the root split, so the tree grows a level
+    extentNode* oldRoot = readNode(root);
+    if (oldRoot == NULL)
+        return -1;
+    int level = oldRoot->level + 1;
+    free(oldRoot);
+
+    int newRoot = newNode(level, root);
+    if (newRoot < 0)
+        return -1;
+    extentNode* node = readNode(newRoot);
+    if (node == NULL)
+        return -1;
+    NODE_CHILDREN(node)[0].fileBlock = 0;
+    NODE_CHILDREN(node)[0].child = root;
+    NODE_CHILDREN(node)[1].fileBlock = siblingKey;
+    NODE_CHILDREN(node)[1].child = sibling;
+    node->numEntries = 2;
+    writeNode(node, newRoot);
+
+    return newRoot;
+}
+
+int extentTreeBlocks(int root) {
+    extentRecord last;
+    if (extentTreeLast(root, &last) < 0)
+        return 0;
+    return last.fileBlock + last.count;
+}
+
+int extentTreeRelease(int root) {
+    extentNode* node = readNode(root);
+    if (node == NULL)
+        return -1;
+
+    int result = 0;
+    for (int i = 0; i < node->numEntries; i++) {
+        if (node->level == 0) {
+            if (NODE_RECORDS(node)[i].count > 0)
+                clearBlocks(NODE_RECORDS(node)[i].blockNumber, NODE_RECORDS(node)[i].count);
+        } else if (extentTreeRelease(NODE_CHILDREN(node)[i].child) < 0) {
+            result = -1;
+        }
+    }
+    free(node);
+
+    clearBlocks(root, 1);
+    return result;
+}
@@ -0,0 +1,86 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: extentTree.h
+ *
+ * Description: Header file for the on-disk extent tree used by files that
+ * outgrow the MAX_EXTENTS inline slots of their directoryEntry, includes exposed
+ * functions: extentTreeBuild(), extentTreeLookup(), extentTreeLast(),
+ * extentTreeSetLastCount(), extentTreeAppend(), extentTreeBlocks(), extentTreeRelease()
+ *
+ * The tree is a B+tree keyed by block offset within the file. Every node is
+ * one block; leaves hold extentRecords, internal nodes hold the first file block
+ * and LBA of each child. A file in tree form has extentLocations[0].count set to
+ * EXTENT_TREE_MARKER and extentLocations[0].blockNumber set to the root node.
+ * Runs are only ever added at the end of a file, so appends walk the rightmost
+ * path and a full node starts a new, empty sibling instead of splitting in half.
+ *
+ **************************************************************/
+#ifndef _EXTENT_TREE_H
+#define _EXTENT_TREE_H
+
+// extentLocations[0].count of a file whose runs live in an extent tree
+#define EXTENT_TREE_MARKER -1
+
+typedef struct extentRecord {
+    int fileBlock;      // first block of the run within the file
+    int blockNumber;    // LBA of the first block of the run
+    int count;          // number of blocks in the run
+} extentRecord;
+
+/**
+ * Creates a tree holding the given runs, in file order.
+ *
+ * @param records    The runs, records[0].fileBlock must be 0 and each run must follow the previous one.
+ * @param numRecords Number of runs.
+ * @param goal       Block to place the tree's nodes near (see allocateBlocksNear()).
+ *
+ * @return LBA of the root node, or -1 if no block could be allocated.
+ */
+int extentTreeBuild(extentRecord* records, int numRecords, int goal);
+
+/**
+ * Finds the run holding a block of the file, reading one node per level.
+ *
+ * @return 0 and the run in out, or -1 if the file has no such block.
+ */
+int extentTreeLookup(int root, int fileBlock, extentRecord* out);
+
+/**
+ * Reads the last run of the file.
+ *
+ * @return 0 and the run in out, or -1 if the tree is empty or unreadable.
+ */
+int extentTreeLast(int root, extentRecord* out);
+
+/**
+ * Changes the length of the last run (growing in place, or trimming blocks past EOF).
+ * The caller owns the blocks added or removed in the bitmap.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+int extentTreeSetLastCount(int root, int count);
+
+/**
+ * Appends a run after the last one.
+ *
+ * @return LBA of the root, which is new when the old root was full, or -1 on failure.
+ */
+int extentTreeAppend(int root, extentRecord* record);
+
+/**
+ * @return Number of file blocks the tree maps (end of the last run).
+ */
+int extentTreeBlocks(int root);
+
+/**
+ * Frees every data run and every node of the tree in the bitmap.
+ *
+ * @return 0 on success, -1 if a node could not be read.
+ */
+int extentTreeRelease(int root);
+
+#endif
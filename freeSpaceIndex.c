@@ -0,0 +1,306 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: freeSpaceIndex.c
+ *
+ * Description: free extent index used by the allocator for best-fit
+ * allocation. Each free run is a single node linked into two AVL trees at
+ * once (left/right/height are indexed by tree), so splitting or merging a run
+ * never copies it between structures.
+ *
+ **************************************************************/
+#include "freeSpaceIndex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BY_START 0  // ordered by start block
+#define BY_SIZE 1   // ordered by (length, start)
+
+typedef struct freeRun {
+    int start;                  // first free block of the run
+    int length;                 // number of free blocks
+    struct freeRun* left[2];    // children, one pair per tree
+    struct freeRun* right[2];
+    int height[2];
+} freeRun;
+
+static freeRun* roots[2] = {NULL, NULL};
+static int indexReady = 0;
+static int runCount = 0;
+
+/* FORWARD DECLARATION BLOCK */
+
+// Inserts node into tree t and returns the new root
+static freeRun* insertNode(freeRun* root, freeRun* node, int t);
+
+// Removes node from tree t and returns the new root
+static freeRun* removeNode(freeRun* root, freeRun* node, int t);
+
+// Allocates a run and links it into both trees
+static void addRun(int start, int length);
+
+// Unlinks a run from both trees and frees it
+static void dropRun(freeRun* run);
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static int compareRuns(const freeRun* a, const freeRun* b, int t) {
+    if (t == BY_SIZE && a->length != b->length)
+        return (a->length < b->length) ? -1 : 1;
+    return (a->start > b->start) - (a->start < b->start);
+}
+
+static int nodeHeight(const freeRun* n, int t) {
+    return n ? n->height[t] : 0;
+}
+
+static void updateHeight(freeRun* n, int t) {
+    int hl = nodeHeight(n->left[t], t);
+    int hr = nodeHeight(n->right[t], t);
+    n->height[t] = 1 + (hl > hr ? hl : hr);
+}
+
+static freeRun* rotateRight(freeRun* y, int t) {
+    freeRun* x = y->left[t];
+    y->left[t] = x->right[t];
+    x->right[t] = y;
+    updateHeight(y, t);
+    updateHeight(x, t);
+    return x;
+}
+
+static freeRun* rotateLeft(freeRun* x, int t) {
+    freeRun* y = x->right[t];
+    x->right[t] = y->left[t];
+    y->left[t] = x;
+    updateHeight(x, t);
+    updateHeight(y, t);
+    return y;
+}
+
+static freeRun* rebalance(freeRun* n, int t) {
+    updateHeight(n, t);
+    int balance = nodeHeight(n->left[t], t) - nodeHeight(n->right[t], t);
+
+    if (balance > 1) {
+        if (nodeHeight(n->left[t]->left[t], t) < nodeHeight(n->left[t]->right[t], t))
+            n->left[t] = rotateLeft(n->left[t], t);
+        return rotateRight(n, t);
+    }
+    if (balance < -1) {
+        if (nodeHeight(n->right[t]->right[t], t) < nodeHeight(n->right[t]->left[t], t))
+            n->right[t] = rotateRight(n->right[t], t);
+        return rotateLeft(n, t);
+    }
+    return n;
+}
+
+static freeRun* insertNode(freeRun* root, freeRun* node, int t) {
+    if (root == NULL) {
+        node->left[t] = node->right[t] = NULL;
+        node->height[t] = 1;
+        return node;
+    }
+
+    if (compareRuns(node, root, t) < 0)
+        root->left[t] = insertNode(root->left[t], node, t);
+    else
+        root->right[t] = insertNode(root->right[t], node, t);
+
+    return rebalance(root, t);
+}
+
+static freeRun* removeMin(freeRun* root, int t, freeRun** minOut) {
+    if (root->left[t] == NULL) {
+        *minOut = root;
+        return root->right[t];
+    }
+    root->left[t] = removeMin(root->left[t], t, minOut);
+    return rebalance(root, t);
+}
+
+static freeRun* removeNode(freeRun* root, freeRun* node, int t) {
+    if (root == NULL)
+        return NULL;
+
+    int c = compareRuns(node, root, t);
+    if (c < 0) {
+        root->left[t] = removeNode(root->left[t], node, t);
+    } else if (c > 0) {
+        root->right[t] = removeNode(root->right[t], node, t);
+    } else {
+        // keys are unique, so this is the node itself: replace it with its successor
+        freeRun* l = root->left[t];
+        freeRun* r = root->right[t];
+        if (r == NULL)
+            return l;
+
+        freeRun* successor;
+        r = removeMin(r, t, &successor);
+        successor->left[t] = l;
+        successor->right[t] = r;
+        return rebalance(successor, t);
+    }
+
+    return rebalance(root, t);
+}
+
+static void addRun(int start, int length) {
+    freeRun* run = malloc(sizeof(freeRun));
+    if (run == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return;
+    }
+    run->start = start;
+    run->length = length;
+    roots[BY_START] = insertNode(roots[BY_START], run, BY_START);
+    roots[BY_SIZE] = insertNode(roots[BY_SIZE], run, BY_SIZE);
+    runCount++;
+}
+
+static void dropRun(freeRun* run) {
+    roots[BY_START] = removeNode(roots[BY_START], run, BY_START);
+    roots[BY_SIZE] = removeNode(roots[BY_SIZE], run, BY_SIZE);
+    runCount--;
+    free(run);
+}
+
+// Run with the largest start <= block, or NULL
+static freeRun* floorByStart(int block) {
+    freeRun* n = roots[BY_START];
+    freeRun* best = NULL;
+    while (n != NULL) {
+        if (n->start <= block) {
+            best = n;
+            n = n->right[BY_START];
+        } else {
+            n = n->left[BY_START];
+        }
+    }
+    return best;
+}
+
+// Run with the smallest start >= block, or NULL
+static freeRun* ceilByStart(int block) {
+    freeRun* n = roots[BY_START];
+    freeRun* best = NULL;
+    while (n != NULL) {
+        if (n->start >= block) {
+            best = n;
+            n = n->left[BY_START];
+        } else {
+            n = n->right[BY_START];
+        }
+    }
+    return best;
+}
+
+// First run overlapping [start, end), or NULL
+static freeRun* firstOverlap(int start, int end) {
+    freeRun* f = floorByStart(start);
+    if (f != NULL && f->start + f->length > start)
+        return f;
+
+    freeRun* c = ceilByStart(start);
+    if (c != NULL && c->start < end)
+        return c;
+
+    return NULL;
+}
+
+static void freeTree(freeRun* n) {
+    if (n == NULL)
+        return;
+    freeTree(n->left[BY_START]);
+    freeTree(n->right[BY_START]);
+    free(n);
+}
+
+void resetFreeIndex() {
+    freeFreeIndex();
+    indexReady = 1;
+}
+
+void freeFreeIndex() {
+    freeTree(roots[BY_START]);
+    roots[BY_START] = roots[BY_SIZE] = NULL;
+    runCount = 0;
+    indexReady = 0;
+}
+
+int freeIndexReady() {
+    return indexReady;
+}
+
+void indexMarkUsed(int start, int length) {
+    if (!indexReady || length <= 0)
+        return;
+
+    int end = start + length;
+    freeRun* run;
+    while ((run = firstOverlap(start, end)) != NULL) {
+        int runStart = run->start;
+        int runEnd = run->start + run->length;
+        dropRun(run);
+
+        // keep whatever part of the run lies outside the used range
+        if (runStart < start)
+            addRun(runStart, start - runStart);
+        if (runEnd > end)
+            addRun(end, runEnd - end);
+    }
+}
+
+void indexMarkFree(int start, int length) {
+    if (!indexReady || length <= 0)
+        return;
+
+    // tolerate ranges that are already partly free
+    indexMarkUsed(start, length);
+
+    int mergedStart = start;
+    int mergedEnd = start + length;
+
+    // coalesce with the run ending right where this one starts
+    freeRun* before = floorByStart(start - 1);
+    if (before != NULL && before->start + before->length == start) {
+        mergedStart = before->start;
+        dropRun(before);
+    }
+
+    // and with the run starting right where this one ends
+    freeRun* after = ceilByStart(mergedEnd);
+    if (after != NULL && after->start == mergedEnd) {
+        mergedEnd = after->start + after->length;
+        dropRun(after);
+    }
+
+    addRun(mergedStart, mergedEnd - mergedStart);
+}
+
+int indexBestFit(int length) {
+    if (!indexReady || length <= 0)
+        return -1;
+
+    // lower bound on (length, -inf) in the size tree
+    freeRun* n = roots[BY_SIZE];
+    freeRun* best = NULL;
+    while (n != NULL) {
+        if (n->length >= length) {
+            best = n;
+            n = n->left[BY_SIZE];
+        } else {
+            n = n->right[BY_SIZE];
+        }
+    }
+
+    return best ? best->start : -1;
+}
+
+int indexFreeExtentCount() {
+    return runCount;
+}
@@ -0,0 +1,63 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: freeSpaceIndex.h
+ *
+ * Description: Header file for the in-memory free extent index kept next to
+ * the bitmap, includes exposed functions: resetFreeIndex(), freeFreeIndex(),
+ * indexMarkUsed(), indexMarkFree(), indexBestFit(), indexFreeExtentCount()
+ *
+ * Every run of free blocks is one node that sits in two balanced (AVL) trees:
+ * one ordered by start block, used to split and merge neighbouring runs, and
+ * one ordered by (length, start), used to answer best-fit requests in O(log n).
+ * The bitmap stays the on-disk source of truth; the index is rebuilt from it
+ * at mount and kept in step by writeBlocks()/clearBlocks().
+ *
+ **************************************************************/
+#ifndef _FREE_SPACE_INDEX_H
+#define _FREE_SPACE_INDEX_H
+
+/**
+ * Drops every node and marks the index as ready to be filled with indexMarkFree().
+ */
+void resetFreeIndex();
+
+/**
+ * Drops every node and marks the index as not ready; until the next
+ * resetFreeIndex() the update functions do nothing and indexBestFit() fails.
+ */
+void freeFreeIndex();
+
+/**
+ * @return 1 once the index has been built, 0 otherwise.
+ */
+int freeIndexReady();
+
+/**
+ * Removes [start, start + length) from the free runs, splitting any run that
+ * only partly overlaps it.
+ */
+void indexMarkUsed(int start, int length);
+
+/**
+ * Adds [start, start + length) to the free runs, merging it with the runs
+ * directly before and after it.
+ */
+void indexMarkFree(int start, int length);
+
+/**
+ * Finds the smallest free run that can hold length blocks (lowest start on ties).
+ *
+ * @return The start block of that run, or -1 if no run is long enough.
+ */
+int indexBestFit(int length);
+
+/**
+ * @return The number of separate free runs currently indexed.
+ */
+int indexFreeExtentCount();
+
+#endif
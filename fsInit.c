@@ -22,24 +22,33 @@
 
 #include "directoryEntry.h"
 #include "bitmap.h"
+#include "blockCache.h"
+#include "dentryCache.h"
 #include "fsLow.h"
+#include "inode.h"
 #include "mfs.h"
+#include "vcb.h"
 
-typedef struct volumeControlBlock {
-    int totalBlock;    // total number of blocks
-    int freeBlock;     // number of free blocks
-    int blockSize;     // size= 512
-    int rootLocation;  // location of root
-    int mapLocation;   // location of free space map
-    int initNumber;    // the numbe to check if VCB initilized
-} VCB;
+
+// Set to 1 (or build with -DCACHE_WRITE_BACK_ON=1) to buffer metadata writes
+// in the block cache until fs_sync()/exitFileSystem()
+#ifndef CACHE_WRITE_BACK_ON
+#define CACHE_WRITE_BACK_ON 0
+#endif
+
+// Set to 0 (or build with -DFORMAT_INODE_TABLE=0) to format new volumes with whole
+// 128 byte entries in directory blocks instead of names and an inode table (see inode.h)
+#ifndef FORMAT_INODE_TABLE
+#define FORMAT_INODE_TABLE 1
+#endif
+
+#define MAX_BLOCK_SIZE 4096  // largest block size the file system formats (smallest is MINBLOCKSIZE)
 
 VCB* vcbPointer;
-int magicNumber = 41804519;  // check if volume is initilized
 
 
 int initVolumeControl(uint64_t numBlock, uint64_t bSize) {
-    int bitmapLocation = initMap(0);
+    int bitmapLocation = initMap(0, numBlock, bSize);
     int vcbLocation = allocateFirstBlocks(1);
     // check if bitmap is initilized & valid
     if (bitmapLocation == -1) {
@@ -50,37 +59,96 @@ int initVolumeControl(uint64_t numBlock, uint64_t bSize) {
     // writing Block 0
     vcbPointer->totalBlock = numBlock;
     vcbPointer->blockSize = bSize;
-    vcbPointer->freeBlock = 0;
-    vcbPointer->initNumber = magicNumber;
+    // new volumes always get the v2 layout
+    vcbPointer->initNumber = VCB_MAGIC_V2;
+    vcbPointer->features = VCB_FEATURE_WIDE_ENTRIES | VCB_FEATURE_DIR_INDEX;
+    vcbPointer->inodeTable = 0;
+    vcbPointer->inodeCount = 0;
     vcbPointer->mapLocation = bitmapLocation;
+
+    // the root's inode is the first one handed out, so the table comes before it
+    if (FORMAT_INODE_TABLE && initInodeTable(numBlock) == 0)
+        vcbPointer->features |= VCB_FEATURE_INODES;
     vcbPointer->rootLocation = initRootDirectory();
+    vcbPointer->freeBlock = countFreeBlocks();
 
-    LBAwrite(vcbPointer, 1, vcbLocation);
+    // block 0 is written from a zeroed block sized buffer, not past the end of the VCB
+    char * tempBuf = calloc(1, bSize);
+    memcpy(tempBuf, vcbPointer, sizeof(VCB));
+    cachedLBAwrite(tempBuf, 1, vcbLocation);
+    free(tempBuf);
 
     return 0;
 }
 
 int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
     printf("Initializing File System with %ld blocks with a block size of %ld\n", numberOfBlocks, blockSize);
+
+    // directories, the bitmap and b_io all work in whole blocks of any power of two in range
+    if (blockSize < MINBLOCKSIZE || blockSize > MAX_BLOCK_SIZE || (blockSize & (blockSize - 1)) != 0) {
+        printf("Unsupported block size %ld, use 512, 1024, 2048 or 4096.\n", blockSize);
+        return -1;
+    }
+
     vcbPointer = malloc(sizeof(VCB));
 
+    // all LBA traffic after this point goes through the block cache
+    if (initBlockCache(DEFAULT_CACHE_BLOCKS, blockSize) != 0) {
+        printf("Error in initilizing block cache.\n");
+        return -1;
+    }
+    setCacheWriteBack(CACHE_WRITE_BACK_ON, DEFAULT_DIRTY_LIMIT);
+    dentryCacheClear();
+
     char * tempBuf = malloc(blockSize);
-    LBAread(tempBuf, 1, 0);
+    cachedLBAread(tempBuf, 1, 0);
     memcpy(vcbPointer, tempBuf, sizeof(VCB));
     free(tempBuf);
 
-    if (vcbPointer->initNumber != magicNumber) {
-        initVolumeControl(numberOfBlocks, blockSize);
+    // a formatted volume keeps the block size it was formatted with
+    if ((vcbPointer->initNumber == VCB_MAGIC_V1 || vcbPointer->initNumber == VCB_MAGIC_V2) &&
+        vcbPointer->blockSize != blockSize) {
+        printf("Volume was formatted with %d byte blocks, not %ld.\n", vcbPointer->blockSize, blockSize);
+        free(vcbPointer);
+        freeBlockCache();
+        return -1;
+    }
+
+    if (vcbPointer->initNumber == VCB_MAGIC_V1) {
+        // v1 volumes predate the feature word, whatever follows initNumber is not ours,
+        // and the map sized by the volume: theirs stays the fixed one the root follows
+        vcbPointer->features = 0;
+        initLegacyMap(vcbPointer->totalBlock, vcbPointer->blockSize);
+    } else if (vcbPointer->initNumber == VCB_MAGIC_V2) {
+        initMap(1, vcbPointer->totalBlock, vcbPointer->blockSize);
     } else {
-        initMap(1);
+        initVolumeControl(numberOfBlocks, blockSize);
     }
 
+    // cwd starts at the root, wherever the bitmap size put it
+    curWorkingDir.d_reclen = DIR_SIZE;
+    curWorkingDir.dirEntryPosition = 0;
+    curWorkingDir.directoryStartLocation = vcbPointer->rootLocation;
+    readDirEntry(vcbPointer->rootLocation, 0, &curWorkingDir.entry);
+    strcpy(curWorkingDir.path, "/");
+
     return 0;
 }
 
 
 void exitFileSystem() {
     printf("System exiting\n");
+
+    // push out everything the write-back cache is still holding
+    fs_sync();
+
+    cacheStats stats;
+    getCacheStats(&stats);
+    printf("Block cache: %lu hits, %lu misses, %lu evictions, %lu write-backs\n",
+        stats.hits, stats.misses, stats.evictions, stats.writebacks);
+
     free(vcbPointer);
     freeMap();
+    freeBlockCache();
+    dentryCacheClear();
 }
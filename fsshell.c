@@ -13,12 +13,14 @@
  *
  **************************************************************/
 
+#include <fnmatch.h>
 #include <getopt.h>
 #include <readline/history.h>
 #include <readline/readline.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -45,6 +47,10 @@
 #define CMDPWD_ON 1
 #define CMDTOUCH_ON 1
 #define CMDCAT_ON 1
+#define CMDSYNC_ON 1
+#define CMDLN_ON 1
+#define CMDDU_ON 1
+#define CMDFIND_ON 1
 
 typedef struct dispatch_t {
     char *command;
@@ -63,21 +69,29 @@ int cmd_cp2l(int argcnt, char *argvec[]);
 int cmd_cp2fs(int argcnt, char *argvec[]);
 int cmd_cd(int argcnt, char *argvec[]);
 int cmd_pwd(int argcnt, char *argvec[]);
+int cmd_sync(int argcnt, char *argvec[]);
+int cmd_ln(int argcnt, char *argvec[]);
+int cmd_du(int argcnt, char *argvec[]);
+int cmd_find(int argcnt, char *argvec[]);
 int cmd_history(int argcnt, char *argvec[]);
 int cmd_help(int argcnt, char *argvec[]);
 
 dispatch_t dispatchTable[] = {
     {"ls", cmd_ls, "Lists the file in a directory"},
-    {"cp", cmd_cp, "Copies a file - source [dest]"},
+    {"cp", cmd_cp, "Copies a file - source [dest], or a directory tree - -r source dest"},
     {"mv", cmd_mv, "Moves a file - source dest"},
     {"md", cmd_md, "Make a new directory"},
-    {"rm", cmd_rm, "Removes a file or directory"},
+    {"rm", cmd_rm, "Removes a file or directory, -r with everything in it"},
     {"touch", cmd_touch, "Touches/Creates a file"},
     {"cat", cmd_cat, "Limited version of cat that displace the file to the console"},
     {"cp2l", cmd_cp2l, "Copies a file from the test file system to the linux file system"},
     {"cp2fs", cmd_cp2fs, "Copies a file from the Linux file system to the test file system"},
     {"cd", cmd_cd, "Changes directory"},
     {"pwd", cmd_pwd, "Prints the working directory"},
+    {"sync", cmd_sync, "Writes all cached changes to the volume"},
+    {"ln", cmd_ln, "Gives a file another name - existing newname"},
+    {"du", cmd_du, "Shows the bytes used under each directory - [path]"},
+    {"find", cmd_find, "Lists every path under a directory - [path] [name pattern]"},
     {"history", cmd_history, "Prints out the history"},
     {"help", cmd_help, "Prints out help"}};
 
@@ -92,19 +106,19 @@ int displayFiles(fdDir *dirp, int flall, int fllong) {
     struct fs_diriteminfo *di;
     struct fs_stat statbuf;
 
-    di = fs_readdir(dirp);
+    // size and type come with each entry, nothing is looked up again by name
+    di = fs_readdirplus(dirp, &statbuf);
     printf("\n");
     while (di != NULL) {
         if ((di->d_name[0] != '.') || (flall))  // if not all and starts with '.' it is hidden
         {
             if (fllong) {
-                fs_stat(di->d_name, &statbuf);
-                printf("%s    %9ld   %s\n", fs_isDir(di->d_name) ? "D" : "-", statbuf.st_size, di->d_name);
+                printf("%s    %9ld   %s\n", (di->fileType == 4) ? "D" : "-", statbuf.st_size, di->d_name);
             } else {
                 printf("%s\n", di->d_name);
             }
         }
-        di = fs_readdir(dirp);
+        di = fs_readdirplus(dirp, &statbuf);
     }
     fs_closedir(dirp);
 #endif
@@ -276,15 +290,120 @@ int cmd_cat(int argcnt, char *argvec[]) {
  *  Copy file commmand
  ****************************************************/
 
-int cmd_cp(int argcnt, char *argvec[]) {
-#if (CMDCP_ON == 1)
+// Copies one file within the test file system
+int copyFile(char *src, char *dest) {
     int testfs_src_fd;
     int testfs_dest_fd;
-    char *src;
-    char *dest;
     int readcnt;
     char buf[BUFFERLEN];
 
+    testfs_src_fd = b_open(src, O_RDONLY);
+    if (testfs_src_fd < 0)
+        return -1;
+    testfs_dest_fd = b_open(dest, O_WRONLY | O_CREAT | O_TRUNC);
+    if (testfs_dest_fd < 0) {
+        b_close(testfs_src_fd);
+        return -1;
+    }
+    do {
+        readcnt = b_read(testfs_src_fd, buf, BUFFERLEN);
+        b_write(testfs_dest_fd, buf, readcnt);
+    } while (readcnt == BUFFERLEN);
+    b_close(testfs_src_fd);
+    b_close(testfs_dest_fd);
+    return 0;
+}
+
+// cp -r: the tree being copied and where its copy goes, for the fs_walk callback
+static size_t copySrcLength;
+static char *copyDestRoot;
+
+// Recreates each directory of the tree under the destination and copies each file into it
+static int copyVisit(const char *path, const struct fs_stat *statbuf, int type, struct fs_walkinfo *info) {
+    char dest[DIRMAX_LEN];
+    if (snprintf(dest, sizeof(dest), "%s%s", copyDestRoot, path + copySrcLength) >= (int)sizeof(dest)) {
+        printf("Path too long: %s\n", path);
+        return -1;
+    }
+
+    if (type == FS_WALK_D)
+        return fs_mkdir(dest, 0777);
+
+    char src[DIRMAX_LEN];
+    strcpy(src, path);
+    if (copyFile(src, dest) < 0) {
+        printf("Could not copy %s to %s\n", path, dest);
+        return -1;
+    }
+    return 0;
+}
+
+// 1 if the directory dir is the directory under, or one above it, found by following ".."
+// up from under until the root, which is its own parent; dir and under must be directories
+static int isAtOrAbove(char *dir, char *under) {
+    struct fs_stat target;
+    struct fs_stat step;
+    if (fs_stat(dir, &target) != 0)
+        return 0;
+
+    char up[DIRMAX_LEN];
+    if (snprintf(up, sizeof(up), "%s", under) >= (int)sizeof(up))
+        return 0;
+    int64_t previous = -1;
+    while (fs_stat(up, &step) == 0 && step.st_location != previous) {
+        if (step.st_location == target.st_location)
+            return 1;
+        previous = step.st_location;
+        if (strlen(up) + 3 >= sizeof(up))
+            break;
+        strcat(up, "/..");
+    }
+    return 0;
+}
+
+int cmd_cp(int argcnt, char *argvec[]) {
+#if (CMDCP_ON == 1)
+    char *src;
+    char *dest;
+
+    if (argcnt == 4 && strcmp(argvec[1], "-r") == 0) {
+        src = argvec[2];
+        dest = argvec[3];
+
+        if (fs_isDir(src) != 1) {
+            printf("%s is not a directory\n", src);
+            return (-1);
+        }
+        if (fs_isDir(dest) != -1) {
+            printf("%s already exists\n", dest);
+            return (-1);
+        }
+
+        // the walk reads each directory before copying it, but a copy inside the tree
+        // would still be walked into: refuse when src is dest's parent or above it,
+        // compared by location so "." and ".." and either spelling of a path count
+        char destParent[DIRMAX_LEN];
+        char *slash = strrchr(dest, '/');
+        if (slash == NULL)
+            strcpy(destParent, ".");
+        else if (slash == dest)
+            strcpy(destParent, "/");
+        else
+            snprintf(destParent, sizeof(destParent), "%.*s", (int)(slash - dest), dest);
+        if (fs_isDir(destParent) != 1) {
+            printf("%s is not a directory\n", destParent);
+            return (-1);
+        }
+        if (isAtOrAbove(src, destParent)) {
+            printf("Cannot copy a directory into itself\n");
+            return (-1);
+        }
+
+        copySrcLength = strlen(src);
+        copyDestRoot = dest;
+        return (fs_walk(src, copyVisit, 0));
+    }
+
     switch (argcnt) {
         case 2:  // only one name provided
             src = argvec[1];
@@ -298,17 +417,11 @@ int cmd_cp(int argcnt, char *argvec[]) {
 
         default:
             printf("Usage: cp srcfile [destfile]\n");
+            printf("       cp -r srcdir destdir\n");
             return (-1);
     }
 
-    testfs_src_fd = b_open(src, O_RDONLY);
-    testfs_dest_fd = b_open(dest, O_WRONLY | O_CREAT | O_TRUNC);
-    do {
-        readcnt = b_read(testfs_src_fd, buf, BUFFERLEN);
-        b_write(testfs_dest_fd, buf, readcnt);
-    } while (readcnt == BUFFERLEN);
-    b_close(testfs_src_fd);
-    b_close(testfs_dest_fd);
+    copyFile(src, dest);
 #endif
     return 0;
 }
@@ -368,10 +481,37 @@ int cmd_md(int argcnt, char *argvec[]) {
 /****************************************************
  *  Remove directory or file commmand
  ****************************************************/
+// rm -r: files as they come, each directory once everything in it is gone (FS_WALK_DEPTH)
+static int removeVisit(const char *path, const struct fs_stat *statbuf, int type, struct fs_walkinfo *info) {
+    char target[DIRMAX_LEN];
+    strcpy(target, path);
+
+    int ret = (type == FS_WALK_DP) ? fs_rmdir(target) : fs_delete(target);
+    if (ret != 0)
+        printf("Could not remove %s\n", path);
+    return ret;
+}
+
 int cmd_rm(int argcnt, char *argvec[]) {
 #if (CMDRM_ON == 1)
+    if (argcnt == 3 && strcmp(argvec[1], "-r") == 0) {
+        // like POSIX rm, refuse "." and ".." and, before emptying it, the cwd or a
+        // directory above it (the root among them), which could not be removed after
+        char *name = strrchr(argvec[2], '/');
+        name = (name == NULL) ? argvec[2] : name + 1;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            printf("rm: refusing to remove '.' or '..' directory: skipping '%s'\n", argvec[2]);
+            return -1;
+        }
+        if (fs_isDir(argvec[2]) == 1 && isAtOrAbove(argvec[2], ".")) {
+            printf("rm: cannot remove '%s': it is the current directory or one above it\n", argvec[2]);
+            return -1;
+        }
+        return fs_walk(argvec[2], removeVisit, FS_WALK_DEPTH);
+    }
+
     if (argcnt != 2) {
-        printf("Usage: rm path\n");
+        printf("Usage: rm [-r] path\n");
         return -1;
     }
 
@@ -460,6 +600,12 @@ int cmd_cp2fs(int argcnt, char *argvec[]) {
 
     testfs_fd = b_open(dest, O_WRONLY | O_CREAT | O_TRUNC);
     linux_fd = open(src, O_RDONLY);
+
+    // the size is known up front, so reserve all of it in one run
+    struct stat srcInfo;
+    if (fstat(linux_fd, &srcInfo) == 0 && srcInfo.st_size > 0)
+        b_fallocate(testfs_fd, 0, srcInfo.st_size);
+
     do {
         readcnt = read(linux_fd, buf, BUFFERLEN);
         b_write(testfs_fd, buf, readcnt);
@@ -520,6 +666,96 @@ int cmd_pwd(int argcnt, char *argvec[]) {
     return 0;
 }
 
+/****************************************************
+ *  Sync commmand
+ ****************************************************/
+int cmd_sync(int argcnt, char *argvec[]) {
+#if (CMDSYNC_ON == 1)
+    if (fs_sync() != 0) {
+        printf("An error occurred while writing cached blocks to the volume\n");
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/****************************************************
+ *  Hard link commmand
+ ****************************************************/
+int cmd_ln(int argcnt, char *argvec[]) {
+#if (CMDLN_ON == 1)
+    if (argcnt != 3) {
+        printf("Usage: ln existing newname\n");
+        return -1;
+    }
+    return fs_link(argvec[1], argvec[2]);
+#endif
+    return 0;
+}
+
+/****************************************************
+ *  Disk usage commmand
+ ****************************************************/
+
+// du: bytes found so far under the directory being summed at each level of the walk
+static off_t usageByLevel[DIRMAX_LEN / 2 + 2];
+
+static int usageVisit(const char *path, const struct fs_stat *statbuf, int type, struct fs_walkinfo *info) {
+    off_t bytes = (off_t)statbuf->st_blocks * statbuf->st_blksize;
+    if (info->level + 1 >= (int)(sizeof(usageByLevel) / sizeof(usageByLevel[0])))
+        return -1;
+
+    if (type == FS_WALK_DP) {
+        // a directory comes after its contents, so its total is complete
+        bytes += usageByLevel[info->level + 1];
+        usageByLevel[info->level + 1] = 0;
+        printf("%-10ld %s\n", (long)bytes, path);
+    } else if (info->level == 0) {
+        printf("%-10ld %s\n", (long)bytes, path);
+    }
+    usageByLevel[info->level] += bytes;
+    return 0;
+}
+
+int cmd_du(int argcnt, char *argvec[]) {
+#if (CMDDU_ON == 1)
+    if (argcnt > 2) {
+        printf("Usage: du [path]\n");
+        return -1;
+    }
+
+    memset(usageByLevel, 0, sizeof(usageByLevel));
+    return fs_walk((argcnt == 2) ? argvec[1] : ".", usageVisit, FS_WALK_DEPTH);
+#endif
+    return 0;
+}
+
+/****************************************************
+ *  Find commmand
+ ****************************************************/
+
+// find: the name pattern to match, NULL to list everything
+static char *findPattern;
+
+static int findVisit(const char *path, const struct fs_stat *statbuf, int type, struct fs_walkinfo *info) {
+    if (findPattern == NULL || fnmatch(findPattern, path + info->base, 0) == 0)
+        printf("%s\n", path);
+    return 0;
+}
+
+int cmd_find(int argcnt, char *argvec[]) {
+#if (CMDFIND_ON == 1)
+    if (argcnt > 3) {
+        printf("Usage: find [path] [name pattern]\n");
+        return -1;
+    }
+
+    findPattern = (argcnt == 3) ? argvec[2] : NULL;
+    return fs_walk((argcnt >= 2) ? argvec[1] : ".", findVisit, 0);
+#endif
+    return 0;
+}
+
 /****************************************************
  *  History commmand
  ****************************************************/
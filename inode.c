@@ -0,0 +1,216 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: inode.c
+ *
+ * Description: inode table of volumes formatted with VCB_FEATURE_INODES.
+ * Inodes are read and written a table block at a time through the block
+ * cache; a free one is found by scanning on from the last one handed out.
+ *
+ **************************************************************/
+#include "inode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "blockCache.h"
+#include "dentryCache.h"
+#include "fsLow.h"
+
+#define INODE_FORMAT_CHUNK 64   // table blocks zeroed per write while formatting
+
+_Static_assert(sizeof(inode) == 128, "inodes must stay 128 bytes");
+
+// next inode number to try when allocating; only a hint, so it survives remounts
+static int64_t allocHint = 1;
+
+/* FORWARD DECLARATION BLOCK */
+
+// Reads the table block holding an inode into a block sized buffer and points node at the
+// inode in it, NULL if there is no such inode
+static inode* readInodeBlock(int64_t ino, inode** node);
+
+// Writes a table block read by readInodeBlock() back and frees the buffer
+static void writeInodeBlock(inode* block, int64_t ino);
+
+/* FORWARD DECLARATION BLOCK END*/
+
+static inode* readInodeBlock(int64_t ino, inode** node) {
+    if (ino < 1 || ino > vcbPointer->inodeCount) {
+        fprintf(stderr, "ERROR: inode %ld is out of range\n", ino);
+        return NULL;
+    }
+
+    inode* block = malloc(vcbPointer->blockSize);
+    if (block == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return NULL;
+    }
+    cachedLBAread(block, 1, vcbPointer->inodeTable + (ino - 1) / INODES_PER_BLOCK);
+    *node = &block[(ino - 1) % INODES_PER_BLOCK];
+    return block;
+}
+
+static void writeInodeBlock(inode* block, int64_t ino) {
+    cachedLBAwrite(block, 1, vcbPointer->inodeTable + (ino - 1) / INODES_PER_BLOCK);
+    free(block);
+}
+
+int initInodeTable(uint64_t numBlock) {
+    int64_t count = (int64_t)numBlock * vcbPointer->blockSize / INODE_BYTES_RATIO;
+    if (count < MIN_INODES)
+        count = MIN_INODES;
+    int64_t tableBlocks = (count + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
+
+    int location = allocateFirstBlocks(tableBlocks);
+    char* zeroes = calloc(INODE_FORMAT_CHUNK, vcbPointer->blockSize);
+    if (location < 0 || zeroes == NULL) {
+        fprintf(stderr, "ERROR: Could not allocate the inode table.\n");
+        free(zeroes);
+        return -1;
+    }
+
+    // every inode starts out free
+    for (int64_t b = 0; b < tableBlocks; b += INODE_FORMAT_CHUNK) {
+        int64_t chunk = (tableBlocks - b < INODE_FORMAT_CHUNK) ? tableBlocks - b : INODE_FORMAT_CHUNK;
+        cachedLBAwrite(zeroes, chunk, location + b);
+    }
+    free(zeroes);
+
+    vcbPointer->inodeTable = location;
+    vcbPointer->inodeCount = tableBlocks * INODES_PER_BLOCK;
+    allocHint = 1;
+    return 0;
+}
+
+int inodeAlloc(directoryEntry* entry) {
+    entry->inode = 0;
+    if (!(vcbPointer->features & VCB_FEATURE_INODES))
+        return 0;
+
+    inode* block = malloc(vcbPointer->blockSize);
+    if (block == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return -1;
+    }
+
+    // one read per table block, starting where the last allocation left off
+    int64_t count = vcbPointer->inodeCount;
+    int64_t start = (allocHint >= 1 && allocHint <= count) ? allocHint : 1;
+    int64_t loadedBlock = -1;
+    for (int64_t n = 0; n < count; n++) {
+        int64_t ino = (start - 1 + n) % count + 1;
+        int64_t tableBlock = (ino - 1) / INODES_PER_BLOCK;
+        if (tableBlock != loadedBlock) {
+            cachedLBAread(block, 1, vcbPointer->inodeTable + tableBlock);
+            loadedBlock = tableBlock;
+        }
+
+        inode* node = &block[(ino - 1) % INODES_PER_BLOCK];
+        if (!node->used) {
+            // claimed right away, so a second allocation before the entry is written cannot take it
+            memset(node, 0, sizeof(inode));
+            node->used = true;
+            writeInodeBlock(block, ino);
+
+            allocHint = ino + 1;
+            entry->inode = ino;
+            return inodeStore(entry);
+        }
+    }
+
+    free(block);
+    fprintf(stderr, "ERROR: No free inodes.\n");
+    return -1;
+}
+
+int inodeLoad(directoryEntry* entry, int64_t ino) {
+    inode* node;
+    inode* block = readInodeBlock(ino, &node);
+    if (block == NULL)
+        return -1;
+    if (!node->used) {
+        fprintf(stderr, "ERROR: inode %ld is not in use\n", ino);
+        free(block);
+        return -1;
+    }
+
+    entry->date = node->date;
+    entry->fileSize = node->fileSize;
+    memcpy(entry->extentLocations, node->extentLocations, sizeof(extent) * MAX_EXTENTS);
+    entry->location = node->location;
+    entry->isDirectory = node->isDirectory;
+    entry->indexLocation = node->indexLocation;
+    entry->indexBlocks = node->indexBlocks;
+    entry->indexUsed = node->indexUsed;
+    entry->inode = ino;
+
+    free(block);
+    return 0;
+}
+
+int inodeStore(directoryEntry* entry) {
+    inode* node;
+    inode* block = readInodeBlock(entry->inode, &node);
+    if (block == NULL)
+        return -1;
+
+    // most writes of a directory block leave its other entries' inodes as they were
+    if (node->date == entry->date && node->fileSize == entry->fileSize &&
+        memcmp(node->extentLocations, entry->extentLocations, sizeof(extent) * MAX_EXTENTS) == 0 &&
+        node->location == entry->location && node->isDirectory == entry->isDirectory &&
+        node->indexLocation == entry->indexLocation && node->indexBlocks == entry->indexBlocks &&
+        node->indexUsed == entry->indexUsed) {
+        free(block);
+        return 0;
+    }
+
+    node->date = entry->date;
+    node->fileSize = entry->fileSize;
+    memcpy(node->extentLocations, entry->extentLocations, sizeof(extent) * MAX_EXTENTS);
+    node->location = entry->location;
+    node->isDirectory = entry->isDirectory;
+    node->indexLocation = entry->indexLocation;
+    node->indexBlocks = entry->indexBlocks;
+    node->indexUsed = entry->indexUsed;
+
+    // the other names of a hard linked file may be cached with the old size and extents
+    int shared = node->linkCount > 1;
+    writeInodeBlock(block, entry->inode);
+    if (shared)
+        dentryCacheInvalidateInode(entry->inode);
+    return 0;
+}
+
+int inodeLink(int64_t ino, int delta) {
+    inode* node;
+    inode* block = readInodeBlock(ino, &node);
+    if (block == NULL)
+        return -1;
+
+    node->linkCount += delta;
+    if (node->linkCount <= 0) {
+        memset(node, 0, sizeof(inode));
+        if (ino < allocHint)
+            allocHint = ino;
+    }
+    writeInodeBlock(block, ino);
+    return 0;
+}
+
+int inodeLinks(directoryEntry* entry) {
+    if (!(vcbPointer->features & VCB_FEATURE_INODES) || entry->inode <= 0)
+        return 1;
+
+    inode* node;
+    inode* block = readInodeBlock(entry->inode, &node);
+    if (block == NULL)
+        return 1;
+    int links = node->linkCount;
+    free(block);
+    return links;
+}
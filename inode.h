@@ -0,0 +1,95 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: inode.h
+ *
+ * Description: Header file for the inode table of volumes formatted with
+ * VCB_FEATURE_INODES, includes exposed functions: initInodeTable(), inodeAlloc(),
+ * inodeLoad(), inodeStore(), inodeLink(), inodeLinks()
+ *
+ * On those volumes a directory block holds only names and inode numbers
+ * (see dirRecord in directoryEntry.h); the size, date, location, extents and
+ * index fields of every file and directory live in one inode of a fixed table
+ * laid out at format time. readDirBlocks()/writeDirBlocks() join the two, so the
+ * rest of the file system keeps working with whole directoryEntry structs.
+ * A directory's "." entry is the copy of its inode that gets written; the entry
+ * in its parent and the ".." entries of its children only point at it. The
+ * link count of an inode is the number of names it has outside "." and "..",
+ * kept by writeDirBlocks(); the inode is freed when it drops to 0.
+ *
+ **************************************************************/
+#ifndef _INODE_H
+#define _INODE_H
+
+#include "directoryEntry.h"
+
+#define INODE_BYTES_RATIO 8192  // the table has one inode per this many bytes of volume
+#define MIN_INODES 64           // but never fewer than this many
+
+// Inode as stored in the table (128 bytes), numbered from 1; 0 means no inode
+typedef struct inode {
+    time_t date;                            // date created
+    uint64_t fileSize;
+    extent extentLocations[MAX_EXTENTS];
+    int64_t location;
+    int64_t indexLocation;                  // hash index of a directory (see dirIndex.h)
+    int indexBlocks;
+    int indexUsed;
+    int linkCount;                          // names outside "." and ".." pointing here
+    bool isDirectory;
+    bool used;                              // Known free state value: false (the whole inode zeroed)
+    char reserved[34];
+} inode;
+
+#define INODES_PER_BLOCK (vcbPointer->blockSize / (int)sizeof(inode))
+
+/**
+ * Lay out an empty inode table while formatting, recording it in the VCB
+ * @param numBlock blocks in the volume
+ * @return 0 on success, -1 if the table could not be allocated
+*/
+int initInodeTable(uint64_t numBlock);
+
+/**
+ * Give a new entry an inode holding its size, date, location and extents.
+ * Does nothing on volumes without VCB_FEATURE_INODES
+ * @param entry the new entry, whose inode field receives the inode number
+ * @return 0 on success, -1 if the table is full
+*/
+int inodeAlloc(directoryEntry* entry);
+
+/**
+ * Fill an entry in from an inode; the name is left alone
+ * @param entry entry to fill in
+ * @param ino inode number
+ * @return 0 on success, -1 if there is no such inode in use
+*/
+int inodeLoad(directoryEntry* entry, int64_t ino);
+
+/**
+ * Write an entry's size, date, location, extents and index fields to its inode,
+ * only when one of them changed
+ * @param entry entry with its inode field set
+ * @return 0 on success, -1 if the entry has no valid inode
+*/
+int inodeStore(directoryEntry* entry);
+
+/**
+ * Add to or take from the link count of an inode, freeing it when the count drops to 0.
+ * The blocks of a freed inode must already have been released by the caller
+ * @param ino inode number
+ * @param delta +1 for a new name, -1 for a removed one
+ * @return 0 on success, -1 if there is no such inode
+*/
+int inodeLink(int64_t ino, int delta);
+
+/**
+ * @param entry a file or directory entry
+ * @return number of names of the entry's inode, always 1 on volumes without an inode table
+*/
+int inodeLinks(directoryEntry* entry);
+
+#endif
@@ -18,19 +18,102 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "blockCache.h"
+#include "dentryCache.h"
+#include "dirIndex.h"
 #include "fsLow.h"
+#include "inode.h"
 #include "pathparse.h"
 
-// cwd is initialized to root at start
-fdDir curWorkingDir = {.d_reclen = DE_SIZE * INIT_NUM_OF_DIRECT, .dirEntryPosition = 0, .directoryStartLocation = LBA_ROOT_LOC};
+// cwd is set to root by initFileSystem once the VCB is loaded
+fdDir curWorkingDir = {.d_reclen = 0, .dirEntryPosition = 0, .directoryStartLocation = 0, .path = "/"};
+
+/* FORWARD DECLARATION BLOCK */
+
+/**
+ * Advances an open directory to its next entry in use, reading a block only when the
+ * position leaves the one in dirp->blockBuffer.
+ * @return the entry, in dirp->blockBuffer, NULL past the last entry
+ */
+static directoryEntry *nextDirEntry(fdDir *dirp);
+
+// Fills in an fs_stat from an entry already read
+static void entryToStat(directoryEntry *entry, struct fs_stat *buf);
+
+/**
+ * Finds the directory a pathname's last name goes in: dir itself for a bare name,
+ * otherwise the path up to the last slash, looked up from dir.
+ * @param name receives the last name, PATH_MAX bytes
+ * @return the directory's entry, to be freed, NULL if it does not exist or is a file
+ */
+static directoryEntry *parentAt(fdDir *dirp, const char *pathname, char *name);
+
+/**
+ * Removes an empty directory, the entry being the one parsePath() found for it
+ * @return 0 on success, -1 if there is no such directory, -2 if it is not empty,
+ *         -3 if it is "." or "..", the cwd or a directory above it
+ */
+static int removeDirectory(directoryEntry *entry);
+
+// 1 if the directory starting at location is the cwd or one of the directories above it
+static int isCwdOrAbove(int64_t location);
+
+/**
+ * Spells a path out from the root, relative ones starting at the cwd path, dropping
+ * "." and resolving ".." by name alone (there are no symbolic links to follow).
+ * @return 0 and the path in out, -1 if it does not fit in size
+ */
+static int absolutePath(const char *pathname, char *out, size_t size);
+
+/**
+ * Reports one entry of fs_walk() to the callback, and walks a directory's contents.
+ * path holds the entry's path, length bytes of it, and is shared by the whole walk
+ */
+static int walkEntry(directoryEntry *entry, char *path, size_t length, int base, int level,
+                     fs_walkfn callback, int flags);
+
+// Reads every block of a directory, then walks each of its entries but "." and ".."
+static int walkDirectory(int64_t dirLocation, char *path, size_t length, int level,
+                         fs_walkfn callback, int flags);
+
+/* FORWARD DECLARATION BLOCK END*/
 
 int fs_mkdir(const char *pathname, mode_t mode) {
-    // Check if the directory already exists
-    directoryEntry *entry = parsePath(pathname);
+    return fs_mkdirat(&curWorkingDir, pathname, mode);
+}
+
+int fs_mkdirat(fdDir *dirp, const char *pathname, mode_t mode) {
+    // Check if the directory already exists; a file by that name is an error
+    directoryEntry *entry = parsePathAt(&dirp->entry, pathname);
     if (entry != NULL) {
+        int isDirectory = entry->isDirectory;
+        free(entry);
+        if (!isDirectory) {
+            fprintf(stderr, "%s: a file by that name exists\n", pathname);
+            return -1;
+        }
         return 0;
     }
 
+    // Check if the parent directory exists
+    char part[PATH_MAX];
+    entry = parentAt(dirp, pathname, part);
+    if (entry == NULL) {
+        fprintf(stderr, "ERROR: path not found\n");
+        return -1;
+    }
+
+    // Create the new directory in the parent directory
+    int location = createDirectory(entry, part);
+    free(entry);
+    if (location < 0) {
+        fprintf(stderr, "ERROR: could not create %s\n", pathname);
+        return location;
+    }
+    return 0;
+}
+
+static directoryEntry *parentAt(fdDir *dirp, const char *pathname, char *name) {
     // Make a copy of the pathname
     char temp[PATH_MAX];
     strncpy(temp, pathname, PATH_MAX - 1);
@@ -38,85 +121,122 @@ int fs_mkdir(const char *pathname, mode_t mode) {
 
     // Find the last slash in the pathname
     char *last_slash = strrchr(temp, '/');
-
-    if (last_slash != NULL) {
-        // Extract the new directory name from the pathname
-        char part[PATH_MAX];
-        strncpy(part, last_slash + 1, PATH_MAX - 1);
-        part[PATH_MAX - 1] = '\0';
-
-        // Remove the new directory name from the pathname
-        *last_slash = '\0';
-
-        // Ensure the pathname starts with a slash
-        if (temp[0] == '\0') {
-            temp[0] = '/';
-            temp[1] = '\0';
-        }
-
-        // Check if the parent directory exists
-        entry = parsePath(temp);
+    if (last_slash == NULL) {
+        // a bare name goes in the directory itself, whose entry is already at hand
+        strcpy(name, temp);
+        directoryEntry *entry = malloc(sizeof(directoryEntry));
         if (entry == NULL) {
-            fprintf(stderr, "ERROR: path not found\n");
-            return -1;
+            fprintf(stderr, "Memory Allocation Error");
+            return NULL;
         }
+        memcpy(entry, &dirp->entry, sizeof(directoryEntry));
+        return entry;
+    }
 
-        // Create the new directory in the parent directory
-        createDirectory(entry, part);
-    } else {
-        // If there's no slash, create the new directory in the current directory
-        entry = parsePath(".");
-        createDirectory(entry, temp);
+    // Extract the last name, then remove it from the pathname
+    strcpy(name, last_slash + 1);
+    *last_slash = '\0';
+
+    // Ensure the pathname starts with a slash
+    if (temp[0] == '\0') {
+        temp[0] = '/';
+        temp[1] = '\0';
     }
-    return 0;
+
+    // a file has no entries to add to or remove from
+    directoryEntry *entry = parsePathAt(&dirp->entry, temp);
+    if (entry != NULL && !entry->isDirectory) {
+        free(entry);
+        return NULL;
+    }
+    return entry;
 }
 
 int fs_rmdir(const char *pathname) {
-    directoryEntry *entry = parsePath(pathname);
+    return fs_unlinkat(&curWorkingDir, pathname, FS_AT_REMOVEDIR);
+}
+
+static int removeDirectory(directoryEntry *entry) {
     if (entry == NULL || !entry->isDirectory) {
+        free(entry);
         return -1;
     }
 
-    directoryEntry *direcToDelete = (directoryEntry *)malloc(entry->fileSize);
-    LBAread(direcToDelete, MIN_BLOCKS_PER_DIR, entry->location);
+    // a "." or ".." entry has no name in the parent to clear, and the cwd would be left
+    // pointing at freed blocks
+    if (strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0 || isCwdOrAbove(entry->location)) {
+        fprintf(stderr, "%s: cannot remove the current directory or one above it\n", entry->name);
+        free(entry);
+        return -3;
+    }
 
-    // check if direct to delete is empty
-    for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-        if (strcmp(direcToDelete[i].name, ".") == 0 || strcmp(direcToDelete[i].name, "..") == 0) {
-            continue;
-        } else if (direcToDelete[i].date != -1) {  // check if entryarray is same name as file name
-            free(entry);
-            free(direcToDelete);
-            fprintf(stderr, "Directory not empty.\n");
-            return -2;
+    dirCursor cursor;
+    directoryEntry *entryArray = (directoryEntry *)malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+    if (entryArray == NULL || dirCursorOpen(&cursor, entry->location) < 0) {
+        free(entry);
+        free(entryArray);
+        return -1;
+    }
+
+    // check if direct to delete is empty, every block of it
+    int64_t lba;
+    while ((lba = dirCursorNext(&cursor)) >= 0) {
+        readDirBlocks(entryArray, 1, lba);
+        for (int i = 0; i < ENTRIES_PER_BLOCK; i++) {
+            if (strcmp(entryArray[i].name, ".") == 0 || strcmp(entryArray[i].name, "..") == 0) {
+                continue;
+            } else if (entryArray[i].date != -1) {  // any entry in use
+                free(entry);
+                free(entryArray);
+                fprintf(stderr, "Directory not empty.\n");
+                return -2;
+            }
         }
     }
 
     // delete entry in parent
-    directoryEntry *parentDirec = (directoryEntry *)malloc(direcToDelete[1].fileSize);
-    LBAread(parentDirec, MIN_BLOCKS_PER_DIR, direcToDelete[1].location);
-
-    for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-        if (strcmp(parentDirec[i].name, entry->name) == 0) {  // check if entryarray is same name as file name
-            // clear blocks from bitmap first
-            clearBlocks(parentDirec[i].location, (parentDirec[i].fileSize + MINBLOCKSIZE - 1) / MINBLOCKSIZE);
-            strcpy(parentDirec[i].name, "");
-            parentDirec[i].fileSize = 0;
-            parentDirec[i].isDirectory = false;
-            parentDirec[i].location = -1;
-            parentDirec[i].date = -1;
-            break;
-        }
+    readDirBlocks(entryArray, 1, entry->location);
+    int64_t parentLocation = entryArray[1].location;
+    int64_t blockInParent = -1;
+    int indexInBlock = -1;
+    if (findDirEntry(parentLocation, entry->name, NULL, &blockInParent, &indexInBlock) < 0) {
+        // nothing may be freed while the parent still points at the directory
+        fprintf(stderr, "ERROR: %s not found in its parent directory\n", entry->name);
+        free(entry);
+        free(entryArray);
+        return -1;
     }
+    readDirBlocks(entryArray, 1, blockInParent);
+    createEntry(&entryArray[indexInBlock], "", false, 0, -1, -1);
+    writeDirBlocks(entryArray, 1, blockInParent);
+
+    // the directory's own "." entry knows every run it has grown and where its hash index is;
+    // the parent's index slot for it simply goes stale
+    releaseEntryBlocks(&cursor.self);
+    dirIndexRelease(&cursor.self);
+
+    // its blocks may soon hold another directory, so none of its cached entries can stay
+    dentryCacheRemoved(parentLocation, entry->name);
+    dentryCacheInvalidateDir(entry->location);
 
-    LBAwrite(parentDirec, MIN_BLOCKS_PER_DIR, direcToDelete[1].location);
     free(entry);
-    free(direcToDelete);
-    free(parentDirec);
+    free(entryArray);
     return 0;
     // removes each directory on the path if and only if it is empty
 }
 
+static int isCwdOrAbove(int64_t location) {
+    // up the ".." entries to the root, whose ".." is itself
+    int64_t dirLocation = curWorkingDir.directoryStartLocation;
+    while (dirLocation != location) {
+        directoryEntry parent;
+        if (readDirEntry(dirLocation, 1, &parent) < 0 || parent.location == dirLocation)
+            return 0;
+        dirLocation = parent.location;
+    }
+    return 1;
+}
+
 // Directory iteration functions
 fdDir *fs_opendir(const char *pathname) {
     directoryEntry *entry = parsePath(pathname);
@@ -126,84 +246,135 @@ fdDir *fs_opendir(const char *pathname) {
     }
 
     fdDir *dir = malloc(sizeof(fdDir));
+    directoryEntry *blockBuffer = malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+    if (dir == NULL || blockBuffer == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        free(dir);
+        free(blockBuffer);
+        free(entry);
+        return NULL;
+    }
+    if (dirCursorOpen(&dir->cursor, entry->location) < 0) {
+        free(dir);
+        free(blockBuffer);
+        free(entry);
+        return NULL;
+    }
+
     dir->d_reclen = entry->fileSize;
     dir->directoryStartLocation = entry->location;
     dir->dirEntryPosition = 0;
+    dir->blockBuffer = blockBuffer;
+    dir->bufferedBlock = -1;
+    memcpy(&dir->entry, entry, sizeof(directoryEntry));
+    if (absolutePath(pathname, dir->path, sizeof(dir->path)) < 0)
+        dir->path[0] = '\0';
     free(entry);
     return dir;
 }
 
-struct fs_diriteminfo *fs_readdir(fdDir *dirp) {
-    directoryEntry *entryArray = (directoryEntry *)malloc(dirp->d_reclen);
-    LBAread(entryArray, dirp->d_reclen / MINBLOCKSIZE, dirp->directoryStartLocation);
-
-    struct fs_diriteminfo *dirItemInfo = malloc(sizeof(struct fs_diriteminfo));
+static directoryEntry *nextDirEntry(fdDir *dirp) {
+    if (dirp->blockBuffer == NULL)
+        return NULL;
 
-    do {
-        dirItemInfo->d_reclen = entryArray[dirp->dirEntryPosition].fileSize;
-        dirItemInfo->fileType = entryArray[dirp->dirEntryPosition].isDirectory ? 4 : 8;
-        strncpy(dirItemInfo->d_name, entryArray[dirp->dirEntryPosition].name, sizeof(dirItemInfo->d_name));
+    while (1) {
+        // the buffered block serves every position in it; only crossing into the next one reads
+        int64_t block = dirp->dirEntryPosition / ENTRIES_PER_BLOCK;
+        if (block != dirp->bufferedBlock) {
+            if (dirp->cursor.block != block)
+                dirCursorSeek(&dirp->cursor, block);
+            int64_t lba = dirCursorNext(&dirp->cursor);
+            if (lba < 0)
+                return NULL;
+            readDirBlocks(dirp->blockBuffer, 1, lba);
+            dirp->bufferedBlock = block;
+        }
 
+        directoryEntry *entry = &dirp->blockBuffer[dirp->dirEntryPosition % ENTRIES_PER_BLOCK];
         dirp->dirEntryPosition++;
+        if (strcmp(entry->name, "") != 0)
+            return entry;
+    }
+}
 
-    } while (strcmp(dirItemInfo->d_name, "") == 0 && dirp->dirEntryPosition < INIT_NUM_OF_DIRECT);
+struct fs_diriteminfo *fs_readdir(fdDir *dirp) {
+    directoryEntry *entry = nextDirEntry(dirp);
+    if (entry == NULL)
+        return NULL;
 
-    free(entryArray);
+    struct fs_diriteminfo *dirItemInfo = &dirp->item;
+    dirItemInfo->d_reclen = entry->fileSize;
+    dirItemInfo->fileType = entry->isDirectory ? 4 : 8;
+    strncpy(dirItemInfo->d_name, entry->name, sizeof(dirItemInfo->d_name));
+    return dirItemInfo;
+}
 
-    if (strcmp(dirItemInfo->d_name, "") == 0) {
-        free(dirItemInfo);
+struct fs_diriteminfo *fs_readdirplus(fdDir *dirp, struct fs_stat *statbuf) {
+    directoryEntry *entry = nextDirEntry(dirp);
+    if (entry == NULL)
         return NULL;
-    }
 
+    // the entry just read from the directory block has everything fs_stat would look up again
+    struct fs_diriteminfo *dirItemInfo = &dirp->item;
+    dirItemInfo->d_reclen = entry->fileSize;
+    dirItemInfo->fileType = entry->isDirectory ? 4 : 8;
+    strncpy(dirItemInfo->d_name, entry->name, sizeof(dirItemInfo->d_name));
+    entryToStat(entry, statbuf);
     return dirItemInfo;
 }
 
 int fs_closedir(fdDir *dirp) {
+    free(dirp->blockBuffer);
     free(dirp);
     dirp = NULL;
     return 0;
 }
 
 // Misc directory functions
-char *fs_getcwd(char *pathname, size_t size) {
-    // Temporary variable to store the current directory
-    directoryEntry *cwd = (directoryEntry *)malloc(INIT_NUM_OF_DIRECT * DE_SIZE);
-    LBAread(cwd, MIN_BLOCKS_PER_DIR, curWorkingDir.directoryStartLocation);
-
-    // Initialize pathname with an empty string
-    pathname[0] = '\0';
-
-    int prevLocation = curWorkingDir.directoryStartLocation;
-    // While the current directory is not the root directory
-    while (cwd[0].location != LBA_ROOT_LOC) {
-        int parentLocation = cwd[1].location;  // Store the parent directory location
-        LBAread(cwd, MIN_BLOCKS_PER_DIR, parentLocation);
-
-        for (int i = 0; i < DE_SIZE; i++) {
-            directoryEntry *entry = &cwd[i];
-
-            // Find the entry that points to the current directory
-            if (entry->location == prevLocation && strcmp(entry->name, ".") != 0) {
-                char temp[PATH_MAX];
-                snprintf(temp, sizeof(temp), "/%s%s", entry->name, pathname);
-                strncpy(pathname, temp, size - 1);
-                pathname[size - 1] = '\0';
-                break;
-            }
+static int absolutePath(const char *pathname, char *out, size_t size) {
+    // the root is kept as "" while building, so every name adds "/name"
+    char built[PATH_MAX] = "";
+    if (pathname[0] != '/' && strcmp(curWorkingDir.path, "/") != 0)
+        strncpy(built, curWorkingDir.path, sizeof(built) - 1);
+    size_t length = strlen(built);
+
+    char copy[PATH_MAX];
+    strncpy(copy, pathname, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+
+    char *savePtr;
+    for (char *token = strtok_r(copy, "/", &savePtr); token != NULL; token = strtok_r(NULL, "/", &savePtr)) {
+        if (strcmp(token, ".") == 0)
+            continue;
+        if (strcmp(token, "..") == 0) {
+            char *lastSlash = strrchr(built, '/');
+            if (lastSlash != NULL)
+                *lastSlash = '\0';
+            length = strlen(built);
+            continue;
         }
 
-        prevLocation = parentLocation;
+        size_t tokenLength = strlen(token);
+        if (length + 1 + tokenLength >= sizeof(built))
+            return -1;
+        built[length++] = '/';
+        memcpy(built + length, token, tokenLength + 1);
+        length += tokenLength;
     }
 
-    // Prepend a '/' to the pathname string if it's not already there
-    if (strlen(pathname) == 0 || pathname[0] != '/') {
-        char temp[PATH_MAX];
-        snprintf(temp, sizeof(temp), "/%s", pathname);
-        strncpy(pathname, temp, size - 1);
-        pathname[size - 1] = '\0';
-    }
+    if (length == 0)
+        strcpy(built, "/");
+    if (strlen(built) >= size)
+        return -1;
+    strcpy(out, built);
+    return 0;
+}
 
-    free(cwd);
+char *fs_getcwd(char *pathname, size_t size) {
+    // fs_setcwd and fs_move keep the path current, so there is nothing to look up
+    if (strlen(curWorkingDir.path) >= size)
+        return NULL;
+    strcpy(pathname, curWorkingDir.path);
     return pathname;
 }
 
@@ -215,12 +386,22 @@ int fs_setcwd(char *pathname) {
     }
     if (!entry->isDirectory) {
         fprintf(stderr, "%s: not a directory\n", entry->name);
+        free(entry);
         return -2;
     }
 
+    char path[PATH_MAX];
+    if (absolutePath(pathname, path, sizeof(path)) < 0) {
+        fprintf(stderr, "ERROR: path too long\n");
+        free(entry);
+        return -1;
+    }
+
     curWorkingDir.d_reclen = entry->fileSize;
     curWorkingDir.dirEntryPosition = 0;
     curWorkingDir.directoryStartLocation = entry->location;
+    memcpy(&curWorkingDir.entry, entry, sizeof(directoryEntry));
+    strcpy(curWorkingDir.path, path);
 
     free(entry);
     return 0;
@@ -254,29 +435,48 @@ int fs_isDir(char *pathname) {
 }
 
 int fs_delete(char *filename) {  // removes file
-    // only looks in current directory
-    directoryEntry *entryArray = (directoryEntry *)malloc(curWorkingDir.d_reclen);
-    LBAread(entryArray, MIN_BLOCKS_PER_DIR, curWorkingDir.directoryStartLocation);
-
-    // loop through the array    //size of the direcotry / blocksize of blocks
-    for (int i = 0; i < curWorkingDir.d_reclen / MINBLOCKSIZE; i++) {
-        if (strcmp(entryArray[i].name, filename) == 0) {  // check if entryarray is same name as file name
-            // clear blocks from bitmap first
-            clearBlocks(entryArray[i].location, ceil(entryArray[i].fileSize / MINBLOCKSIZE));
-            strcpy(entryArray[i].name, "");
-            entryArray[i].fileSize = 0;
-            entryArray[i].isDirectory = false;
-            entryArray[i].location = -1;
-            entryArray[i].date = -1;
-
-            // free bitmap please
+    return fs_unlinkat(&curWorkingDir, filename, 0);
+}
 
-            break;
-        }
+int fs_unlinkat(fdDir *dirp, const char *pathname, int flags) {
+    if (flags & FS_AT_REMOVEDIR)
+        return removeDirectory(parsePathAt(&dirp->entry, pathname));
+
+    // only looks in the file's own directory, in any block of it
+    char name[PATH_MAX];
+    directoryEntry *parent = parentAt(dirp, pathname, name);
+    if (parent == NULL)
+        return -1;
+
+    int64_t blockToEditDE = -1;
+    int indexInBlock = -1;
+    if (findDirEntry(parent->location, name, NULL, &blockToEditDE, &indexInBlock) < 0) {
+        free(parent);
+        return -1;
     }
 
+    directoryEntry *entryArray = (directoryEntry *)malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+    readDirBlocks(entryArray, 1, blockToEditDE);
+    if (entryArray[indexInBlock].isDirectory) {
+        fprintf(stderr, "%s: is a directory\n", name);
+        free(entryArray);
+        free(parent);
+        return -2;
+    }
+
+    // clear blocks from bitmap first, unless another name still has them (see fs_link),
+    // then leave the entry in a known free state
+    if (inodeLinks(&entryArray[indexInBlock]) <= 1)
+        releaseEntryBlocks(&entryArray[indexInBlock]);
+    createEntry(&entryArray[indexInBlock], "", false, 0, -1, -1);
+
     // write to LBA to update the deletion of the file
-    LBAwrite(entryArray, curWorkingDir.d_reclen / MINBLOCKSIZE, curWorkingDir.directoryStartLocation);
+    writeDirBlocks(entryArray, 1, blockToEditDE);
+    dentryCacheRemoved(parent->location, name);
+
+    free(entryArray);
+    free(parent);
+    return 0;
 }
 
 void concatPath(char *dest, const char *src) {
@@ -376,71 +576,171 @@ int fs_move(const char *srcPathname, const char *destPathname) {
         return -4;
     }
     free(testDest);
-    // destination directory
-    directoryEntry *destDirect = (directoryEntry *)malloc(INIT_NUM_OF_DIRECT * DE_SIZE);
-    LBAread(destDirect, MIN_BLOCKS_PER_DIR, destEntry->location);
 
-    // directory being moved
-    directoryEntry *movedDirectory = (directoryEntry *)malloc(INIT_NUM_OF_DIRECT * DE_SIZE);
-    directoryEntry *srcDirect = (directoryEntry *)malloc(INIT_NUM_OF_DIRECT * DE_SIZE);
+    // directory the source is in: a moved directory's ".." says, a file's parent was parsed above
+    directoryEntry *blockBuf = (directoryEntry *)malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+    int64_t srcParentLocation;
     if (selfDirect == NULL) {
-        LBAread(movedDirectory, 1, srcEntry->location);
-        LBAread(srcDirect, MIN_BLOCKS_PER_DIR, movedDirectory[1].location);
+        readDirBlocks(blockBuf, 1, srcEntry->location);
+        srcParentLocation = blockBuf[1].location;
     } else {
-        LBAread(movedDirectory, 1, selfDirect->location);
-        LBAread(srcDirect, MIN_BLOCKS_PER_DIR, movedDirectory[0].location);
+        srcParentLocation = selfDirect->location;
     }
 
-    // copy directory
-    for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-        if (destDirect[i].date == -1) {
-            memcpy(&destDirect[i], srcEntry, sizeof(directoryEntry));
-            if (srcEntry->isDirectory) {
-                movedDirectory[1].location = destDirect[0].location;
-            }
-            break;
-        }
+    // copy directory into a free entry of the destination, which grows when it is full
+    int64_t destBlock = -1;
+    int destIndex = -1;
+    if (findFreeDirSlot(destEntry->location, &destBlock, &destIndex) < 0) {
+        fprintf(stderr, "Destination directory is full\n");
+        free(blockBuf);
+        free(selfDirect);
+        free(destEntry);
+        free(srcEntry);
+        return -6;
+    }
+    readDirBlocks(blockBuf, 1, destBlock);
+    memcpy(&blockBuf[destIndex], srcEntry, sizeof(directoryEntry));
+    writeDirBlocks(blockBuf, 1, destBlock);
+
+    // a moved directory's ".." now points at the destination (and its inode, if it has one)
+    if (srcEntry->isDirectory) {
+        readDirBlocks(blockBuf, 1, srcEntry->location);
+        blockBuf[1].location = destEntry->location;
+        blockBuf[1].inode = destEntry->inode;
+        writeDirBlocks(blockBuf, 1, srcEntry->location);
     }
 
-    LBAwrite(destDirect, MIN_BLOCKS_PER_DIR, destEntry->location);
-    LBAwrite(movedDirectory, 1, movedDirectory[0].location);
-    free(movedDirectory);
-    free(destDirect);
-
-    directoryEntry *blankEntry = calloc(1, sizeof(directoryEntry));
-    createEntry(blankEntry, "", false, 0, -1, -1);
-
-    // deleting source
-    for (int i = 0; i < INIT_NUM_OF_DIRECT; i++) {
-        if (strcmp(srcDirect[i].name, srcEntry->name) == 0) {
-            memcpy(&srcDirect[i], blankEntry, sizeof(directoryEntry));
-            break;
+    // deleting source, wherever in its directory it is
+    int64_t srcBlock = -1;
+    int srcIndex = -1;
+    if (findDirEntry(srcParentLocation, srcEntry->name, NULL, &srcBlock, &srcIndex) == 0) {
+        readDirBlocks(blockBuf, 1, srcBlock);
+        createEntry(&blockBuf[srcIndex], "", false, 0, -1, -1);
+        writeDirBlocks(blockBuf, 1, srcBlock);
+    }
+    dentryCacheRemoved(srcParentLocation, srcEntry->name);
+
+    // the destination's index learns the name; the source's slot goes stale
+    dirIndexAdd(destEntry->location, srcEntry->name, destBlock, destIndex);
+    dentryCacheCreated(destEntry->location, srcEntry->name);
+
+    // the cwd is kept by path, which changes when it or a directory above it moves
+    char oldPath[PATH_MAX];
+    char newPath[PATH_MAX];
+    if (srcEntry->isDirectory && absolutePath(srcPathname, oldPath, sizeof(oldPath)) == 0 &&
+        absolutePath(destDup, newPath, sizeof(newPath)) == 0 && strcmp(oldPath, "/") != 0) {
+        size_t oldLength = strlen(oldPath);
+        char *rest = curWorkingDir.path + oldLength;
+        if (strncmp(curWorkingDir.path, oldPath, oldLength) == 0 && (*rest == '/' || *rest == '\0') &&
+            strlen(newPath) + strlen(rest) < sizeof(newPath)) {
+            strcat(newPath, rest);
+            strcpy(curWorkingDir.path, newPath);
         }
     }
-    LBAwrite(srcDirect, MIN_BLOCKS_PER_DIR, srcDirect[0].location);
 
     if (selfDirect != NULL) {
         free(selfDirect);
     }
-    free(srcDirect);
-    free(blankEntry);
+    free(blockBuf);
     free(destEntry);
     free(srcEntry);
     return 0;
 }
 
+int fs_link(const char *existingPath, const char *newPath) {
+    if (!(vcbPointer->features & VCB_FEATURE_INODES)) {
+        fprintf(stderr, "Hard links need a volume with an inode table\n");
+        return -5;
+    }
+
+    directoryEntry *entry = parsePath(existingPath);
+    if (entry == NULL) {
+        fprintf(stderr, "Source doesn't exist\n");
+        return -1;
+    }
+    if (entry->isDirectory) {
+        free(entry);
+        fprintf(stderr, "Cannot link a directory\n");
+        return -2;
+    }
+
+    // split the new path into its directory and name, as fs_mkdir does
+    char temp[PATH_MAX];
+    strncpy(temp, newPath, PATH_MAX - 1);
+    temp[PATH_MAX - 1] = '\0';
+    char *name = temp;
+    directoryEntry *parent;
+    char *last_slash = strrchr(temp, '/');
+    if (last_slash != NULL) {
+        *last_slash = '\0';
+        name = last_slash + 1;
+        parent = parsePath((temp[0] == '\0') ? "/" : temp);
+    } else {
+        parent = parsePath(".");
+    }
+    if (parent == NULL || !parent->isDirectory) {
+        free(parent);
+        free(entry);
+        fprintf(stderr, "Destination folder doesn't exist\n");
+        return -3;
+    }
+
+    directoryEntry *existing = parsePath(newPath);
+    if (existing != NULL || name[0] == '\0' || strlen(name) >= sizeof(entry->name)) {
+        free(existing);
+        free(parent);
+        free(entry);
+        fprintf(stderr, "Destination name already exists\n");
+        return -4;
+    }
+
+    // a copy of the entry under the new name points at the same inode, whose link count goes up
+    int64_t destBlock = -1;
+    int destIndex = -1;
+    strcpy(entry->name, name);
+    if (findFreeDirSlot(parent->location, &destBlock, &destIndex) < 0 ||
+        writeDirEntry(destBlock, destIndex, entry) < 0) {
+        free(parent);
+        free(entry);
+        fprintf(stderr, "Destination directory is full\n");
+        return -6;
+    }
+
+    dirIndexAdd(parent->location, name, destBlock, destIndex);
+    dentryCacheCreated(parent->location, name);
+
+    free(parent);
+    free(entry);
+    return 0;
+}
+
+int fs_sync() {
+    return flushBlockCache();
+}
+
 int fs_stat(const char *path, struct fs_stat *buf) {
-    directoryEntry *entry = parsePath(path);
+    return fs_statat(&curWorkingDir, path, buf);
+}
+
+int fs_statat(fdDir *dirp, const char *path, struct fs_stat *buf) {
+    directoryEntry *entry = parsePathAt(&dirp->entry, path);
 
     // If entry does not exist
     if (entry == NULL)
         return -1;
 
+    entryToStat(entry, buf);
+    free(entry);
+
+    return 0;
+}
+
+static void entryToStat(directoryEntry *entry, struct fs_stat *buf) {
     // Entry block size
-    buf->st_blksize = 512;
+    buf->st_blksize = vcbPointer->blockSize;
 
     // Entry file size info
-    buf->st_blocks = (entry->fileSize + MINBLOCKSIZE - 1) / MINBLOCKSIZE;
+    buf->st_blocks = (entry->fileSize + buf->st_blksize - 1) / buf->st_blksize;
     buf->st_size = entry->fileSize;
 
     // Entry dates
@@ -452,11 +752,106 @@ int fs_stat(const char *path, struct fs_stat *buf) {
     buf->st_location = entry->location;
     // Entry extent info
     memcpy(&(buf->st_extents), &(entry->extentLocations), sizeof(extent) * MAX_EXTENTS);
+    buf->st_nlink = inodeLinks(entry);
 
-    strcpy(buf->st_name, entry->name);
+    strncpy(buf->st_name, entry->name, PATH_MAX - 1);
     buf->st_name[PATH_MAX - 1] = '\0';
+}
 
+int fs_walk(const char *root, fs_walkfn callback, int flags) {
+    directoryEntry *entry = parsePath(root);
+    if (entry == NULL) {
+        fprintf(stderr, "ERROR: path not found\n");
+        return -1;
+    }
+
+    // the paths handed out start with root as given, without a trailing slash
+    char path[PATH_MAX];
+    strncpy(path, root, PATH_MAX - 1);
+    path[PATH_MAX - 1] = '\0';
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/')
+        path[--length] = '\0';
+
+    char *lastSlash = strrchr(path, '/');
+    int base = (lastSlash == NULL || length == 1) ? 0 : (int)(lastSlash - path) + 1;
+
+    int result = walkEntry(entry, path, length, base, 0, callback, flags);
     free(entry);
+    return result;
+}
+
+static int walkEntry(directoryEntry *entry, char *path, size_t length, int base, int level,
+                     fs_walkfn callback, int flags) {
+    struct fs_stat statbuf;
+    entryToStat(entry, &statbuf);
+    struct fs_walkinfo info = {.base = base, .level = level};
 
+    if (!entry->isDirectory)
+        return callback(path, &statbuf, FS_WALK_F, &info);
+
+    int result;
+    if (!(flags & FS_WALK_DEPTH) && (result = callback(path, &statbuf, FS_WALK_D, &info)) != 0)
+        return result;
+
+    if ((result = walkDirectory(entry->location, path, length, level, callback, flags)) != 0)
+        return result;
+
+    if (flags & FS_WALK_DEPTH)
+        return callback(path, &statbuf, FS_WALK_DP, &info);
     return 0;
-}
\ No newline at end of file
+}
+
+static int walkDirectory(int64_t dirLocation, char *path, size_t length, int level,
+                         fs_walkfn callback, int flags) {
+    dirCursor cursor;
+    if (dirCursorOpen(&cursor, dirLocation) < 0)
+        return -1;
+
+    directoryEntry *entries = malloc(cursor.blocks * ENTRIES_PER_BLOCK * DE_SIZE);
+    if (entries == NULL) {
+        fprintf(stderr, "Memory Allocation Error");
+        return -1;
+    }
+
+    // the whole directory is read before the callback runs: one read per run of it (as much
+    // of a run as the cache takes in one go), and nothing the callback removes is read again
+    int64_t blocks = 0;
+    while (blocks < cursor.blocks) {
+        int64_t runLeft;
+        int64_t lba = dirBlockToLBA(&cursor.self, blocks, &runLeft);
+        if (lba < 0)
+            break;
+
+        int64_t count = cursor.blocks - blocks;
+        if (count > runLeft)
+            count = runLeft;
+        if (count > CACHE_BYPASS_BLOCKS)
+            count = CACHE_BYPASS_BLOCKS;
+        readDirBlocks(&entries[blocks * ENTRIES_PER_BLOCK], count, lba);
+        blocks += count;
+    }
+
+    // names go after the directory's path and a '/', which "/" already ends in
+    size_t dirLength = (length > 0 && path[length - 1] == '/') ? length : length + 1;
+    int result = 0;
+    for (int64_t i = 0; i < blocks * ENTRIES_PER_BLOCK && result == 0; i++) {
+        directoryEntry *entry = &entries[i];
+        if (entry->name[0] == '\0' || strcmp(entry->name, ".") == 0 || strcmp(entry->name, "..") == 0)
+            continue;
+
+        size_t nameLength = strlen(entry->name);
+        if (dirLength + nameLength >= PATH_MAX) {
+            fprintf(stderr, "ERROR: path too long under %s\n", path);
+            continue;
+        }
+        path[length] = '/';
+        memcpy(path + dirLength, entry->name, nameLength + 1);
+
+        result = walkEntry(entry, path, dirLength + nameLength, (int)dirLength, level + 1, callback, flags);
+        path[length] = '\0';
+    }
+
+    free(entries);
+    return result;
+}
@@ -24,6 +24,7 @@
 #define FT_REGFILE DT_REG
 #define FT_DIRECTORY DT_DIR
 #define FT_LINK DT_LNK
+#define FS_AT_REMOVEDIR 0x200  /* fs_unlinkat removes a directory, like AT_REMOVEDIR */
 
 #ifndef uint64_t
 typedef u_int64_t uint64_t;
@@ -44,22 +45,43 @@ struct fs_diriteminfo {
 
 typedef struct {
     unsigned short d_reclen;         /*length of this record*/
-    unsigned short dirEntryPosition; /*directory entry position eg offset from the start of the block */
+    uint64_t dirEntryPosition;       /*directory entry position eg offset from the start of the directory, across all its blocks */
     uint64_t directoryStartLocation; /*Starting LBA of directory */
+    dirCursor cursor;                /*walk over the directory's blocks and runs, opened by fs_opendir */
+    directoryEntry *blockBuffer;     /*entries of one directory block, ENTRIES_PER_BLOCK of them */
+    int64_t bufferedBlock;           /*index within the directory of the block in blockBuffer, -1 for none */
+    struct fs_diriteminfo item;      /*what fs_readdir returns, valid until the next call or fs_closedir */
+    directoryEntry entry;            /*the directory's own entry, as parsePath found it */
+    char path[PATH_MAX];             /*absolute path of the directory, with no "." or ".." in it */
 } fdDir;
 extern fdDir curWorkingDir;
 // Key directory functions
+// The *at functions take an open fdDir (curWorkingDir included) as a directory handle:
+// a relative pathname is looked up from that directory, which is never walked to again
+// from the root, and an absolute one from the root as usual.
 
 /**
  * Creates a new directory at the given path with the specified mode.
  *
  * @param pathname The path where the new directory should be created.
  * @param mode The mode (permissions) for the new directory.
- * @return 0 on success, -1 on failure.
+ * @return 0 on success (or if the directory already exists), negative on failure, see fs_mkdirat().
  */
 int fs_mkdir(const char *pathname, mode_t mode);
 
 
+/**
+ * Creates a new directory like fs_mkdir(), a relative pathname starting at an open directory.
+ *
+ * @param dirp The directory handle.
+ * @param pathname The path where the new directory should be created.
+ * @param mode The mode (permissions) for the new directory.
+ * @return 0 on success (or if the directory already exists),
+ *         -1 if its parent does not exist or a file has its name,
+ *         -2 if the parent is full and could not grow or there is no room for the directory.
+ */
+int fs_mkdirat(fdDir *dirp, const char *pathname, mode_t mode);
+
 int fs_rmdir(const char *pathname);
 
 /**
@@ -73,13 +95,17 @@ fdDir *fs_opendir(const char *pathname);
 /**
  * Reads the next directory entry from the given directory structure.
  *
+ * Reads a block of the directory only when the position moves past the one buffered,
+ * so iterating a directory costs one read per block. The returned item belongs to the
+ * fdDir and is overwritten by the next call; do not free it.
+ *
  * @param dirp A pointer to the opened directory structure.
  * @return A pointer to the directory entry information (fs_diriteminfo) on success, NULL on failure.
  */
 struct fs_diriteminfo *fs_readdir(fdDir *dirp);
 
 /**
- * Closes the given directory structure.
+ * Closes the given directory structure, freeing its buffered block and item.
  *
  * @param dirp A pointer to the opened directory structure.
  * @return 0 on success.
@@ -88,19 +114,19 @@ int fs_closedir(fdDir *dirp);
 
 
 /**
- * Gets the current working directory.
+ * Gets the current working directory, a copy of the path kept in curWorkingDir.
  *
  * @param pathname A buffer to store the current working directory path.
  * @param size The size of the buffer.
- * @return A pointer to the pathname buffer on success, NULL on failure.
+ * @return A pointer to the pathname buffer on success, NULL if the path does not fit.
  */
 char *fs_getcwd(char *pathname, size_t size);
 
 /**
- * Sets the current working directory.
+ * Sets the current working directory, keeping its entry and absolute path in curWorkingDir.
  *
  * @param pathname The path of the new working directory.
- * @return 0 on success, -1 if the path is not found, -2 if the path is not a directory.
+ * @return 0 on success, -1 if the path is not found or too long, -2 if the path is not a directory.
  */
 int fs_setcwd(char *pathname);
 
@@ -128,6 +154,29 @@ int fs_isDir(char *pathname);
  */
 int fs_delete(char *filename);  // removes a file
 
+/**
+ * Deletes a file, or with FS_AT_REMOVEDIR an empty directory, a relative pathname
+ * starting at an open directory. fs_delete() and fs_rmdir() work from the cwd through it.
+ *
+ * @param dirp The directory handle.
+ * @param pathname The path of the file or directory.
+ * @param flags 0 or FS_AT_REMOVEDIR.
+ * @return 0 on success, -1 if it does not exist (or is not a directory, with FS_AT_REMOVEDIR),
+ *         -2 if it is a directory (without FS_AT_REMOVEDIR) or a directory that is not empty,
+ *         -3 if the directory is "." or "..", the cwd or a directory above it.
+ */
+int fs_unlinkat(fdDir *dirp, const char *pathname, int flags);
+
+/**
+ * Opens a file like b_open(), a relative pathname starting at an open directory.
+ *
+ * @param dirp The directory handle.
+ * @param filename The path of the file.
+ * @param flags O_RDONLY, O_WRONLY or O_RDWR, with O_CREAT and O_TRUNC as for b_open().
+ * @return The file descriptor for b_read()/b_write() on success, negative on failure.
+ */
+b_io_fd fs_openat(fdDir *dirp, const char *filename, int flags);
+
 /**
  * Moves a file or directory from a source path to a destination path.
  * 
@@ -139,21 +188,49 @@ int fs_delete(char *filename);  // removes a file
  *         -2 if the destination folder does not exist.
  *         -3 if the destination is a file, not a directory.
  *         -4 if a file or directory with the same name already exists at the destination.
+ *         -5 if a directory would be moved into its own subdirectory.
+ *         -6 if the destination directory is full and could not grow.
  */
 int fs_move(const char* srcPathname, const char* destPathname);
 
+/**
+ * Gives an existing file another name (a hard link); both names then share one inode,
+ * and the file's blocks are freed once the last name is deleted.
+ * Only volumes with an inode table (VCB_FEATURE_INODES) have hard links.
+ *
+ * @param existingPath The path of the file.
+ * @param newPath The path of the new name, in an existing directory.
+ *
+ * @return 0 if the operation is successful.
+ *         -1 if the file does not exist.
+ *         -2 if it is a directory.
+ *         -3 if the new name's directory does not exist.
+ *         -4 if the new name already exists.
+ *         -5 if the volume has no inode table.
+ *         -6 if the new name's directory is full and could not grow.
+ */
+int fs_link(const char* existingPath, const char* newPath);
+
+/**
+ * Writes every block held dirty by the write-back cache to the volume.
+ *
+ * @return 0 on success, -1 if a write failed.
+ */
+int fs_sync();
+
 // This is the structure that is filled in from a call to fs_stat
 struct fs_stat {
     off_t st_size;        /* total size, in bytes */
     blksize_t st_blksize; /* blocksize for file system I/O */
-    blkcnt_t st_blocks;   /* number of 512B blocks allocated */
+    blkcnt_t st_blocks;   /* number of st_blksize blocks allocated */
     time_t st_accesstime; /* time of last access */
     time_t st_modtime;    /* time of last modification */
     time_t st_createtime; /* time of last status change */
 
     /* add additional attributes here for your file system */
-    short st_location;
+    int64_t st_location;
     extent st_extents[MAX_EXTENTS];
+    int st_nlink;         /* number of names of the file, see fs_link() */
     char st_name[PATH_MAX];
 };
 
@@ -166,4 +243,55 @@ struct fs_stat {
  */
 int fs_stat(const char *path, struct fs_stat *buf);
 
+/**
+ * Retrieves file or directory information like fs_stat(), a relative path starting at an open directory.
+ *
+ * @param dirp The directory handle.
+ * @param path The path of the file or directory.
+ * @param buf A pointer to the fs_stat structure to store the information.
+ * @return 0 on success, -1 on failure.
+ */
+int fs_statat(fdDir *dirp, const char *path, struct fs_stat *buf);
+
+/**
+ * Reads the next directory entry like fs_readdir(), and fills in its fs_stat from the
+ * same read of the directory, so listing a directory with sizes and dates costs no
+ * path lookups per entry.
+ *
+ * @param dirp A pointer to the opened directory structure.
+ * @param statbuf A pointer to the fs_stat structure to store the entry's information.
+ * @return A pointer to the directory entry information (fs_diriteminfo) on success, NULL past the last entry.
+ */
+struct fs_diriteminfo *fs_readdirplus(fdDir *dirp, struct fs_stat *statbuf);
+
+// What fs_walk found, passed to its callback, like nftw's FTW_F, FTW_D and FTW_DP
+#define FS_WALK_F 1   /* a file */
+#define FS_WALK_D 2   /* a directory, before its contents */
+#define FS_WALK_DP 3  /* a directory, after its contents (with FS_WALK_DEPTH) */
+
+// Flags of fs_walk
+#define FS_WALK_DEPTH 0x1  /* report directories after their contents, like FTW_DEPTH */
+
+// Where an entry is in the walk, like nftw's struct FTW
+struct fs_walkinfo {
+    int base;   /* offset of the entry's name in the path */
+    int level;  /* depth below the root of the walk, 0 for the root itself */
+};
+
+typedef int (*fs_walkfn)(const char *path, const struct fs_stat *statbuf, int type, struct fs_walkinfo *info);
+
+/**
+ * Walks the tree under root, calling callback for root and every file and directory
+ * below it, like nftw(). Each directory is read straight from its blocks, a run at a
+ * time, before the callback sees any of its entries: a walk reads every directory
+ * block once, looks up no paths, and the callback may remove what it is given.
+ *
+ * @param root The path the walk starts at; the paths given to callback begin with it.
+ * @param callback Called for each entry; a nonzero return stops the walk.
+ * @param flags 0 or FS_WALK_DEPTH.
+ * @return 0 once every entry has been visited, the callback's value if it stopped the walk,
+ *         -1 if root does not exist or a directory could not be read.
+ */
+int fs_walk(const char *root, fs_walkfn callback, int flags);
+
 #endif
@@ -18,12 +18,14 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "blockCache.h"
+#include "dentryCache.h"
 #include "fsLow.h"
 #include "mfs.h"
 
 typedef struct {
-    int location;
-    int size;
+    int64_t location;
+    uint64_t size;
 } parsePathInfo;
 
 
@@ -47,15 +49,16 @@ static bool isDoubleDot(const char *pathname) {
  * Sets the initial directory information based on the given pathname.
  *
  * @param dInfo Pointer to the parsePathInfo structure to be initialized.
+ * @param dir The directory a relative pathname starts from.
  * @param pathname The path string used for initializing the structure.
  */
-static void setInitialDirectoryInfo(parsePathInfo *dInfo, const char *pathname) {
+static void setInitialDirectoryInfo(parsePathInfo *dInfo, const directoryEntry *dir, const char *pathname) {
     if (isAbsolutePath(pathname)) {
         dInfo->location = LBA_ROOT_LOC;
-        dInfo->size = DE_SIZE * INIT_NUM_OF_DIRECT;
+        dInfo->size = DIR_SIZE;
     } else {
-        dInfo->location = curWorkingDir.directoryStartLocation;
-        dInfo->size = curWorkingDir.d_reclen;
+        dInfo->location = dir->location;
+        dInfo->size = dir->fileSize;
     }
 }
 
@@ -94,15 +97,15 @@ static directoryEntry *handleSpecialCases(const char *pathname, parsePathInfo *d
     directoryEntry *entry = malloc(sizeof(directoryEntry));
 
     if (isSingleSlash(pathname) || isSingleDot(pathname)) {
-        directoryEntry *tempStructArray = malloc(MINBLOCKSIZE);
-        LBAread(tempStructArray, 1, dInfo->location);
+        directoryEntry *tempStructArray = malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+        readDirBlocks(tempStructArray, 1, dInfo->location);
         memcpy(entry, &tempStructArray[0], sizeof(directoryEntry));
         free(tempStructArray);
     } else if (isDoubleDot(pathname)) {
-        directoryEntry *tempCurrent = (directoryEntry *)malloc(ENTRIES_PER_BLOCK * MINBLOCKSIZE);
-        LBAread(tempCurrent, 1, dInfo->location);
-        directoryEntry *tempStructArray = malloc(DE_SIZE * MINBLOCKSIZE);
-        LBAread(tempStructArray, 1, tempCurrent[1].location);
+        directoryEntry *tempCurrent = (directoryEntry *)malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+        readDirBlocks(tempCurrent, 1, dInfo->location);
+        directoryEntry *tempStructArray = malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+        readDirBlocks(tempStructArray, 1, tempCurrent[1].location);
         memcpy(entry, &tempStructArray[0], sizeof(directoryEntry));
         free(tempStructArray);
         free(tempCurrent);
@@ -127,38 +130,13 @@ static void handleDotDotToken(directoryEntry *entryArray, parsePathInfo *dInfo,
     memcpy(lastFoundEntry, &entryArray[1], sizeof(directoryEntry));
 }
 
-/**
- * Searches for the given token in the array of directory entries, updating the parsePathInfo structure 
- * and last found entry if found.
- *
- * @param entryArray The array of directory entries.
- * @param token The token to search for in the directory entries.
- * @param dInfo Pointer to the parsePathInfo structure containing directory information.
- * @param lastFoundEntry Pointer to the last found directory entry.
- * @return true if the token is found in the directory entries, false otherwise.
- */
-static bool findTokenInEntryArray(directoryEntry *entryArray, const char *token, parsePathInfo *dInfo, directoryEntry *lastFoundEntry) {
-    int numberOfEntries = dInfo->size / DE_SIZE;
-
-    for (int i = 0; i < numberOfEntries; i++) {
-        if (!strcmp(entryArray[i].name, token)) {
-            memcpy(lastFoundEntry, &entryArray[i], sizeof(directoryEntry));
-
-            if (entryArray[i].isDirectory) {
-                dInfo->location = entryArray[i].location;
-                dInfo->size = entryArray[i].fileSize;
-            }
-            return true;
-        }
-    }
-
-    return false;
+directoryEntry *parsePath(const char *pathname) {
+    return parsePathAt(&curWorkingDir.entry, pathname);
 }
 
-directoryEntry *parsePath(const char *pathname) {
-    
+directoryEntry *parsePathAt(const directoryEntry *dir, const char *pathname) {
     parsePathInfo dInfo;
-    setInitialDirectoryInfo(&dInfo, pathname);
+    setInitialDirectoryInfo(&dInfo, dir, pathname);
     char *copy, *savePtr;
     char *token = getFirstToken(pathname, &copy, &savePtr);
     directoryEntry *lastFoundEntry = malloc(sizeof(directoryEntry));
@@ -168,22 +146,38 @@ directoryEntry *parsePath(const char *pathname) {
         return lastFoundEntry;
     }
     while (token != NULL) {
-        
-        directoryEntry *entryArray = (directoryEntry *)malloc(dInfo.size);
-        LBAread(entryArray, MIN_BLOCKS_PER_DIR, dInfo.location);
-        
         if (isSingleDot(token)) {
             // do nothing
         } else if (isDoubleDot(token)) {
+            // ".." is always in the directory's first block
+            directoryEntry *entryArray = (directoryEntry *)malloc(ENTRIES_PER_BLOCK * DE_SIZE);
+            readDirBlocks(entryArray, 1, dInfo.location);
             handleDotDotToken(entryArray, &dInfo, lastFoundEntry);
-        } else if (!findTokenInEntryArray(entryArray, token, &dInfo, lastFoundEntry)) {
             free(entryArray);
-            free(lastFoundEntry);
-            free(copy);
-            return NULL;
+        } else {
+            // a cached answer needs no reads at all, nor does a miss the directory's name
+            // filter rules out; the rest go to its index, or a scan of every block of it
+            int64_t dirLocation = dInfo.location;
+            int found = dentryCacheLookup(dirLocation, token, lastFoundEntry);
+            if (found == 0 && dentryCacheMayContain(dirLocation, token) == 0)
+                found = -1;
+            if (found == 0)
+                found = (findDirEntry(dirLocation, token, lastFoundEntry, NULL, NULL) == 0) ? 1 : -1;
+
+            if (found == -1) {
+                dentryCacheInsertNegative(dirLocation, token);
+                free(lastFoundEntry);
+                free(copy);
+                return NULL;
+            }
+
+            dentryCacheInsert(dirLocation, token, lastFoundEntry);
+            if (lastFoundEntry->isDirectory) {
+                dInfo.location = lastFoundEntry->location;
+                dInfo.size = lastFoundEntry->fileSize;
+            }
         }
         token = strtok_r(NULL, "/", &savePtr);
-        free(entryArray);
     }
 
     free(copy);
@@ -6,7 +6,7 @@
  *
  * File:
  *
- * Description: exposed parsePath function
+ * Description: exposed parsePath and parsePathAt functions
  * 
  * 
  *
@@ -28,4 +28,14 @@
  */
 directoryEntry *parsePath(const char *pathname);
 
+/**
+ * Parses a pathname like parsePath(), with a relative one starting at the given
+ * directory instead of the current working directory.
+ *
+ * @param dir The directory's entry; only its location and size are used.
+ * @param pathname The input pathname string to be parsed.
+ * @return A pointer to a directoryEntry structure if the parsing is successful, NULL otherwise.
+ */
+directoryEntry *parsePathAt(const directoryEntry *dir, const char *pathname);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,43 @@
+/**************************************************************
+ * Class:  CSC-415-03 Fall 2023
+ * Names: Nathan Rennacker, Suzanna Li
+ * Group Name: CN2S
+ * Project: Basic File System
+ *
+ * File: vcb.h
+ *
+ * Description: Volume control block (block 0 of the volume), shared so the
+ * rest of the file system can find the root directory and volume geometry
+ *
+ *
+ **************************************************************/
+#ifndef _VCB_H
+#define _VCB_H
+
+// initNumber of a formatted volume, the version of its on-disk layout:
+//      v1 - 64 byte directory entries with 16-bit block numbers and a 32-bit size
+//      v2 - 128 byte directory entries with 64-bit block numbers and sizes, and a feature word
+#define VCB_MAGIC_V1 41804519
+#define VCB_MAGIC_V2 41804520
+
+// features of a v2 volume (always 0 on v1, which has no feature word)
+#define VCB_FEATURE_WIDE_ENTRIES 0x1   // directory entries use the 128 byte v2 layout
+#define VCB_FEATURE_DIR_INDEX 0x2      // directories grown past their first run get a hash index of their names (dirIndex.h)
+#define VCB_FEATURE_INODES 0x4         // directory blocks hold names and inode numbers, the rest is in an inode table (inode.h)
+
+typedef struct volumeControlBlock {
+    int totalBlock;    // total number of blocks
+    int freeBlock;     // number of free blocks
+    int blockSize;     // size= 512
+    int rootLocation;  // location of root
+    int mapLocation;   // location of free space map
+    int initNumber;    // the numbe to check if VCB initilized, VCB_MAGIC_V1 or VCB_MAGIC_V2
+    int features;      // VCB_FEATURE_* flags, only stored on v2 volumes
+    int inodeTable;    // location of the inode table, with VCB_FEATURE_INODES
+    int inodeCount;    // number of inodes in it
+} VCB;
+
+// Loaded by initFileSystem, valid until exitFileSystem
+extern VCB* vcbPointer;
+
+#endif